@@ -0,0 +1,151 @@
+
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+#include "hash_funcs.h"
+#include "arc.h"
+
+#define LEN(arc, l)	((arc)->lists[l].n)
+#define TAIL(arc, l)	dlist_entry((arc)->lists[l].tail, struct arc_ele, node)
+
+static void move_to(struct arc *arc, struct arc_ele *ele, uint32 list)
+{
+	dlist_remove(&arc->lists[ele->list], &ele->node);
+	ele->list = list;
+	dlist_push_head(&arc->lists[list], &ele->node);
+}
+
+/* forgets the oldest key of a ghost list */
+static void drop_ghost(struct arc *arc, uint32 list)
+{
+	struct arc_ele * ele = TAIL(arc, list);
+
+	dlist_remove(&arc->lists[list], &ele->node);
+	hash_delete(arc->ghosts, ele->key, NULL);
+	pool_free(arc->pool, ele);
+}
+
+/* evicts the lru block of t1 or t2 onto its ghost list */
+static void replace(struct arc *arc, uint32 in_b2, uint64 *removed_key)
+{
+	struct arc_ele * ele;
+
+	if (LEN(arc, ARC_T1) && (LEN(arc, ARC_T1) > arc->p ||
+				(in_b2 && LEN(arc, ARC_T1) == arc->p))) {
+		ele = TAIL(arc, ARC_T1);
+		move_to(arc, ele, ARC_B1);
+	} else {
+		ele = TAIL(arc, ARC_T2);
+		move_to(arc, ele, ARC_B2);
+	}
+	*removed_key = ele->key;
+	hash_insert(arc->ghosts, ele->key, ele);
+}
+
+struct arc * arc_init (uint32 max_elements)
+{
+	struct arc * arc;
+
+	if (max_elements == 0) {
+		return NULL;
+	}
+	arc = malloc(sizeof(*arc));
+	if (arc == NULL) {
+		return NULL;
+	}
+	memset(arc, 0, sizeof(*arc));
+	arc->max_elements = max_elements;
+	arc->pool = pool_init(sizeof(struct arc_ele), 0);
+	arc->ghosts = hash_init(1024, HASH_OPEN, hash_murmur);
+	if (arc->pool == NULL || arc->ghosts == NULL) {
+		arc_destroy(arc);
+		return NULL;
+	}
+	return arc;
+}
+
+struct arc_ele* arc_insert (struct arc *arc, uint64 key, uint64 *removed_key)
+{
+	struct arc_ele * ele;
+	uint32 c = arc->max_elements;
+	uint32 full = arc_num_elements(arc) == c;
+	uint32 delta, total;
+	void * data;
+
+	*removed_key = INVALID_KEY;
+	if (hash_delete(arc->ghosts, key, &data)) {
+		ele = data;
+		if (ele->list == ARC_B1) {
+			delta = LEN(arc, ARC_B2)/LEN(arc, ARC_B1);
+			delta = delta ? delta : 1;
+			arc->p = arc->p + delta < c ? arc->p + delta : c;
+		} else {
+			delta = LEN(arc, ARC_B1)/LEN(arc, ARC_B2);
+			delta = delta ? delta : 1;
+			arc->p = arc->p > delta ? arc->p - delta : 0;
+		}
+		if (full) {
+			replace(arc, ele->list == ARC_B2, removed_key);
+		}
+		move_to(arc, ele, ARC_T2);
+		return ele;
+	}
+	total = arc_num_elements(arc) + LEN(arc, ARC_B1) + LEN(arc, ARC_B2);
+	if (LEN(arc, ARC_T1) + LEN(arc, ARC_B1) == c) {
+		if (LEN(arc, ARC_T1) < c) {
+			drop_ghost(arc, ARC_B1);
+			replace(arc, 0, removed_key);
+		} else {
+			// t1 is the whole cache, its lru block is not remembered
+			ele = TAIL(arc, ARC_T1);
+			*removed_key = ele->key;
+			dlist_remove(&arc->lists[ARC_T1], &ele->node);
+			pool_free(arc->pool, ele);
+		}
+	} else if (total >= c) {
+		if (total == 2*c) {
+			drop_ghost(arc, ARC_B2);
+		}
+		if (full) {
+			replace(arc, 0, removed_key);
+		}
+	}
+	ele = pool_alloc(arc->pool);
+	if (ele == NULL) {
+		return NULL;
+	}
+	ele->key = key;
+	ele->list = ARC_T1;
+	dlist_push_head(&arc->lists[ARC_T1], &ele->node);
+	return ele;
+}
+
+uint32 arc_bump (struct arc *arc, struct arc_ele *ele)
+{
+	if (ele->list == ARC_T2) {
+		dlist_move_head(&arc->lists[ARC_T2], &ele->node);
+	} else {
+		move_to(arc, ele, ARC_T2);
+	}
+	return SUCCESS;
+}
+
+uint32 arc_num_elements (struct arc *arc)
+{
+	return LEN(arc, ARC_T1) + LEN(arc, ARC_T2);
+}
+
+uint64 arc_memory (struct arc *arc)
+{
+	return sizeof(*arc) + pool_bytes(arc->pool) + hash_memory(arc->ghosts);
+}
+
+void arc_destroy (struct arc *arc)
+{
+	if (arc == NULL) {
+		return;
+	}
+	pool_destroy(arc->pool);
+	hash_destroy(arc->ghosts);
+	free(arc);
+}
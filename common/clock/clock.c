@@ -0,0 +1,68 @@
+
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+#include "clock.h"
+
+struct clock * clock_init (uint32 max_elements)
+{
+	struct clock * clock;
+
+	if (max_elements == 0) {
+		return NULL;
+	}
+	clock = malloc(sizeof(*clock));
+	if (clock == NULL) {
+		return NULL;
+	}
+	memset(clock, 0, sizeof(*clock));
+	clock->max_elements = max_elements;
+	clock->eles = malloc(sizeof(struct clock_ele)*(uint64)max_elements);
+	if (clock->eles == NULL) {
+		free(clock);
+		return NULL;
+	}
+	return clock;
+}
+
+struct clock_ele* clock_insert (struct clock *clock, uint64 key, uint64 *removed_key)
+{
+	struct clock_ele * ele;
+
+	*removed_key = INVALID_KEY;
+	if (clock->nelements < clock->max_elements) {
+		// still filling up, slots are handed out in ring order
+		ele = &clock->eles[clock->nelements++];
+	} else {
+		while (clock->eles[clock->hand].ref) {
+			clock->eles[clock->hand].ref = 0;
+			if (++clock->hand == clock->max_elements)	clock->hand = 0;
+		}
+		ele = &clock->eles[clock->hand];
+		*removed_key = ele->key;
+		if (++clock->hand == clock->max_elements)	clock->hand = 0;
+	}
+	ele->key = key;
+	ele->ref = 0;
+	return ele;
+}
+
+uint32 clock_bump (struct clock *clock, struct clock_ele *ele)
+{
+	ele->ref = 1;
+	return SUCCESS;
+}
+
+uint64 clock_memory (struct clock *clock)
+{
+	return sizeof(*clock) + (uint64)sizeof(struct clock_ele)*clock->max_elements;
+}
+
+void clock_destroy (struct clock *clock)
+{
+	if (clock == NULL) {
+		return;
+	}
+	free(clock->eles);
+	free(clock);
+}
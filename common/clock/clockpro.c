@@ -0,0 +1,289 @@
+
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+#include "hash_funcs.h"
+#include "clock.h"
+
+#define NIL	0xFFFFFFFF
+#define IS(e, f)	((e)->flags & CLOCKPRO_##f)
+
+/*
+ * all pages, resident or not, sit on one circular list of slot indices.
+ * the hands walk it in the next direction and new pages go in just
+ * behind hand_hot, so they are the last ones any hand reaches.
+ */
+
+static uint32 cold_max(struct clockpro *cp)
+{
+	return cp->max_elements > 1 ? cp->max_elements - 1 : 1;
+}
+
+static void cp_link_head(struct clockpro *cp, uint32 i)
+{
+	struct clockpro_ele * e = &cp->eles[i];
+	uint32 h = cp->hand_hot;
+
+	if (h == NIL) {
+		e->next = e->prev = i;
+		cp->hand_hot = cp->hand_cold = cp->hand_test = i;
+		return;
+	}
+	e->next = h;
+	e->prev = cp->eles[h].prev;
+	cp->eles[e->prev].next = i;
+	cp->eles[h].prev = i;
+}
+
+static void cp_unlink(struct clockpro *cp, uint32 i)
+{
+	struct clockpro_ele * e = &cp->eles[i];
+
+	if (e->next == i) {
+		cp->hand_hot = cp->hand_cold = cp->hand_test = NIL;
+		return;
+	}
+	// hands on the page just move on to the next one
+	if (cp->hand_hot == i)	cp->hand_hot = e->next;
+	if (cp->hand_cold == i)	cp->hand_cold = e->next;
+	if (cp->hand_test == i)	cp->hand_test = e->next;
+	cp->eles[e->prev].next = e->next;
+	cp->eles[e->next].prev = e->prev;
+}
+
+static uint32 cp_alloc(struct clockpro *cp)
+{
+	uint32 i;
+
+	if (cp->free != NIL) {
+		i = cp->free;
+		cp->free = cp->eles[i].next;
+		return i;
+	}
+	return cp->nused++;
+}
+
+static void cp_remove(struct clockpro *cp, uint32 i)
+{
+	cp_unlink(cp, i);
+	cp->eles[i].next = cp->free;
+	cp->free = i;
+}
+
+/* a cold page leaves its test period, a non resident one is forgotten */
+static void cp_end_test(struct clockpro *cp, uint32 i)
+{
+	struct clockpro_ele * e = &cp->eles[i];
+
+	e->flags &= ~CLOCKPRO_TEST;
+	if (cp->cold_target > 1) {
+		cp->cold_target--;
+	}
+	if (!IS(e, RESIDENT)) {
+		hash_delete(cp->ghosts, e->key, NULL);
+		cp->nnonres--;
+		cp_remove(cp, i);
+	}
+}
+
+/* turns one hot page cold, ending the test periods it passes */
+static void run_hand_hot(struct clockpro *cp)
+{
+	struct clockpro_ele * e;
+	uint32 i;
+
+	while (cp->nhot) {
+		i = cp->hand_hot;
+		e = &cp->eles[i];
+		if (IS(e, HOT)) {
+			cp->hand_hot = e->next;
+			if (IS(e, REF)) {
+				e->flags &= ~CLOCKPRO_REF;
+				continue;
+			}
+			e->flags &= ~CLOCKPRO_HOT;
+			cp->nhot--;
+			cp->ncold++;
+			return;
+		}
+		if (IS(e, TEST) && IS(e, RESIDENT)) {
+			cp->hand_hot = e->next;
+			cp_end_test(cp, i);
+		} else if (IS(e, TEST)) {
+			cp_end_test(cp, i);
+		} else {
+			cp->hand_hot = e->next;
+		}
+	}
+}
+
+/* forgets one non resident page */
+static void run_hand_test(struct clockpro *cp)
+{
+	struct clockpro_ele * e;
+	uint32 i;
+
+	while (cp->nnonres) {
+		i = cp->hand_test;
+		e = &cp->eles[i];
+		if (IS(e, HOT) || !IS(e, TEST)) {
+			cp->hand_test = e->next;
+		} else if (IS(e, RESIDENT)) {
+			cp->hand_test = e->next;
+			cp_end_test(cp, i);
+		} else {
+			cp_end_test(cp, i);
+			return;
+		}
+	}
+}
+
+/* evicts one resident cold page */
+static void run_hand_cold(struct clockpro *cp, uint64 *removed_key)
+{
+	struct clockpro_ele * e;
+	uint32 i;
+
+	for (;;) {
+		if (cp->ncold == 0) {
+			run_hand_hot(cp);
+			continue;
+		}
+		i = cp->hand_cold;
+		e = &cp->eles[i];
+		if (IS(e, HOT) || !IS(e, RESIDENT)) {
+			cp->hand_cold = e->next;
+			continue;
+		}
+		if (IS(e, REF)) {
+			// reused: hot if it was in its test period, else start one
+			e->flags &= ~CLOCKPRO_REF;
+			cp_unlink(cp, i);
+			cp_link_head(cp, i);
+			if (IS(e, TEST)) {
+				e->flags = (e->flags & ~CLOCKPRO_TEST) | CLOCKPRO_HOT;
+				cp->ncold--;
+				cp->nhot++;
+				while (cp->nhot > cp->max_elements - cp->cold_target) {
+					run_hand_hot(cp);
+				}
+			} else {
+				e->flags |= CLOCKPRO_TEST;
+			}
+			continue;
+		}
+		*removed_key = e->key;
+		cp->ncold--;
+		if (!IS(e, TEST)) {
+			cp_remove(cp, i);
+			return;
+		}
+		// keep remembering it until the test period ends
+		e->flags &= ~CLOCKPRO_RESIDENT;
+		hash_insert(cp->ghosts, e->key, e);
+		cp->nnonres++;
+		cp->hand_cold = e->next;
+		while (cp->nnonres > cp->max_elements) {
+			run_hand_test(cp);
+		}
+		return;
+	}
+}
+
+struct clockpro * clockpro_init (uint32 max_elements)
+{
+	struct clockpro * cp;
+
+	if (max_elements == 0 || max_elements >= NIL/2) {
+		return NULL;
+	}
+	cp = malloc(sizeof(*cp));
+	if (cp == NULL) {
+		return NULL;
+	}
+	memset(cp, 0, sizeof(*cp));
+	cp->max_elements = max_elements;
+	// resident and non resident pages, plus the one being added
+	cp->size = 2*max_elements + 1;
+	cp->eles = malloc(sizeof(struct clockpro_ele)*(uint64)cp->size);
+	cp->ghosts = hash_init(1024, HASH_OPEN, hash_murmur);
+	if (cp->eles == NULL || cp->ghosts == NULL) {
+		clockpro_destroy(cp);
+		return NULL;
+	}
+	cp->free = NIL;
+	cp->hand_hot = cp->hand_cold = cp->hand_test = NIL;
+	cp->cold_target = max_elements/100 ? max_elements/100 : 1;
+	if (cp->cold_target > cold_max(cp)) {
+		cp->cold_target = cold_max(cp);
+	}
+	return cp;
+}
+
+struct clockpro_ele* clockpro_insert (struct clockpro *cp, uint64 key, uint64 *removed_key)
+{
+	struct clockpro_ele * e;
+	void * data;
+	uint32 i;
+
+	*removed_key = INVALID_KEY;
+	if (hash_lookup(cp->ghosts, key, NULL)) {
+		// reused within its test period, give cold pages more room
+		if (cp->cold_target < cold_max(cp)) {
+			cp->cold_target++;
+		}
+		if (cp->nhot + cp->ncold == cp->max_elements) {
+			run_hand_cold(cp, removed_key);
+		}
+		// making room may have ended its test period
+		if (hash_delete(cp->ghosts, key, &data)) {
+			e = data;
+			i = e - cp->eles;
+			cp->nnonres--;
+			cp_unlink(cp, i);
+			cp_link_head(cp, i);
+			e->flags = CLOCKPRO_HOT | CLOCKPRO_RESIDENT;
+			cp->nhot++;
+			while (cp->nhot > cp->max_elements - cp->cold_target) {
+				run_hand_hot(cp);
+			}
+			return e;
+		}
+	} else if (cp->nhot + cp->ncold == cp->max_elements) {
+		run_hand_cold(cp, removed_key);
+	}
+	i = cp_alloc(cp);
+	e = &cp->eles[i];
+	e->key = key;
+	e->flags = CLOCKPRO_RESIDENT | CLOCKPRO_TEST;
+	cp->ncold++;
+	cp_link_head(cp, i);
+	return e;
+}
+
+uint32 clockpro_bump (struct clockpro *cp, struct clockpro_ele *ele)
+{
+	ele->flags |= CLOCKPRO_REF;
+	return SUCCESS;
+}
+
+uint32 clockpro_num_elements (struct clockpro *cp)
+{
+	return cp->nhot + cp->ncold;
+}
+
+uint64 clockpro_memory (struct clockpro *cp)
+{
+	return sizeof(*cp) + (uint64)sizeof(struct clockpro_ele)*cp->size +
+		hash_memory(cp->ghosts);
+}
+
+void clockpro_destroy (struct clockpro *cp)
+{
+	if (cp == NULL) {
+		return;
+	}
+	hash_destroy(cp->ghosts);
+	free(cp->eles);
+	free(cp);
+}
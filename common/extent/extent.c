@@ -0,0 +1,250 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+#include "extent.h"
+#include "hash_funcs.h"
+
+#define EXTENT_DEFAULT_CHUNK	(256)
+
+struct extent_index * extent_init (uint64 max_blocks, uint32 chunk_blocks)
+{
+	struct extent_index * idx = malloc(sizeof(*idx));
+	if (idx == NULL) {
+		return NULL;
+	}
+	memset(idx, 0, sizeof(*idx));
+	idx->max_blocks = max_blocks;
+	idx->chunk_blocks = chunk_blocks ? chunk_blocks : EXTENT_DEFAULT_CHUNK;
+	idx->chunks = hash_init(1024, HASH_OPEN, hash_murmur);
+	// the index evicts by block count, the list itself is unbounded
+	idx->lru = lru_init(0xFFFFFFFF);
+	idx->extent_pool = pool_init(sizeof(struct extent), 0);
+	idx->chunk_pool = pool_init(sizeof(struct extent_chunk), 0);
+	if (!idx->chunks || !idx->lru || !idx->extent_pool || !idx->chunk_pool) {
+		extent_destroy(idx);
+		return NULL;
+	}
+	return idx;
+}
+
+static struct extent_chunk * find_chunk (struct extent_index *idx, uint64 c)
+{
+	struct extent_chunk * chunk = NULL;
+
+	hash_lookup(idx->chunks, c, (void **)&chunk);
+	return chunk;
+}
+
+static struct extent_chunk * get_chunk (struct extent_index *idx, uint64 c)
+{
+	struct extent_chunk * chunk = find_chunk(idx, c);
+
+	if (chunk) {
+		return chunk;
+	}
+	chunk = pool_alloc(idx->chunk_pool);
+	if (chunk == NULL) {
+		return NULL;
+	}
+	chunk->first = NULL;
+	if (!hash_insert(idx->chunks, c, chunk)) {
+		pool_free(idx->chunk_pool, chunk);
+		return NULL;
+	}
+	return chunk;
+}
+
+/* the extent an lru element stands for, its key is the extent start */
+static struct extent * extent_of (struct extent_index *idx, struct lru_ele *ele)
+{
+	struct extent_chunk * chunk = find_chunk(idx, ele->key / idx->chunk_blocks);
+	struct extent * e = chunk ? chunk->first : NULL;
+
+	while (e && e->start != ele->key) {
+		e = e->next;
+	}
+	return e;
+}
+
+/*
+ * adds [start, start+len) to its chunk, in the lru just above pos or at
+ * the head when pos is NULL.
+ */
+static struct extent * add_extent (struct extent_index *idx, uint64 start, uint32 len,
+		struct lru_ele *pos)
+{
+	struct extent_chunk * chunk = get_chunk(idx, start / idx->chunk_blocks);
+	struct extent * e, ** link;
+	uint64 removed_key;
+
+	if (chunk == NULL) {
+		return NULL;
+	}
+	e = pool_alloc(idx->extent_pool);
+	if (e == NULL) {
+		return NULL;
+	}
+	e->start = start;
+	e->len = len;
+	e->ele = pos ? lru_insert_after(idx->lru, pos, start) :
+			lru_insert(idx->lru, start, &removed_key);
+	if (e->ele == NULL) {
+		pool_free(idx->extent_pool, e);
+		return NULL;
+	}
+	link = &chunk->first;
+	while (*link && (*link)->start < start) {
+		link = &(*link)->next;
+	}
+	e->next = *link;
+	*link = e;
+	return e;
+}
+
+static void remove_extent (struct extent_index *idx, struct extent *e)
+{
+	uint64 c = e->start / idx->chunk_blocks;
+	struct extent_chunk * chunk = find_chunk(idx, c);
+	struct extent ** link = &chunk->first;
+
+	while (*link != e) {
+		link = &(*link)->next;
+	}
+	*link = e->next;
+	if (chunk->first == NULL) {
+		hash_delete(idx->chunks, c, NULL);
+		pool_free(idx->chunk_pool, chunk);
+	}
+	lru_remove(idx->lru, e->ele);
+	pool_free(idx->extent_pool, e);
+}
+
+/* drops nblks blocks from the cold end, oldest (lowest) blocks first */
+static void evict (struct extent_index *idx, uint64 nblks)
+{
+	struct extent * e;
+	uint64 n;
+
+	while (nblks && idx->lru->tail) {
+		e = extent_of(idx, idx->lru->tail);
+		n = e->len < nblks ? e->len : nblks;
+		if (n == e->len) {
+			remove_extent(idx, e);
+		} else {
+			e->start += n;
+			e->len -= n;
+			e->ele->key = e->start;
+		}
+		idx->nblocks -= n;
+		nblks -= n;
+	}
+}
+
+/*
+ * e was just put at the head, fold it into the extent below it if that
+ * one ends where e starts.
+ */
+static void merge_head (struct extent_index *idx, struct extent *e)
+{
+	struct lru_ele * below = e->ele->prev;
+	struct extent * prev;
+
+	if (below == NULL || below->key >= e->start ||
+			below->key / idx->chunk_blocks != e->start / idx->chunk_blocks) {
+		return;
+	}
+	prev = extent_of(idx, below);
+	if (prev->start + prev->len != e->start) {
+		return;
+	}
+	prev->len += e->len;
+	remove_extent(idx, e);
+}
+
+void extent_access (struct extent_index *idx, uint64 start, uint64 nblks, uint64 *hits, uint64 *misses)
+{
+	struct extent_chunk * chunk;
+	struct extent * e, * x;
+	uint64 p = start, end = start + nblks;
+	uint64 c, lim, seg_end, e_end, n;
+
+	while (p < end) {
+		c = p / idx->chunk_blocks;
+		lim = (c + 1)*idx->chunk_blocks;
+		if (lim > end)	lim = end;
+		chunk = find_chunk(idx, c);
+		e = NULL;
+		seg_end = lim;
+		for (x = chunk ? chunk->first : NULL; x; x = x->next) {
+			if (x->start + x->len <= p) {
+				continue;
+			}
+			if (x->start <= p) {
+				e = x;
+			} else if (x->start < lim) {
+				seg_end = x->start;
+			}
+			break;
+		}
+		if (e) {
+			e_end = e->start + e->len;
+			seg_end = e_end < lim ? e_end : lim;
+			*hits += seg_end - p;
+			// the part above the hit keeps the place of the whole extent
+			if (seg_end < e_end) {
+				add_extent(idx, seg_end, e_end - seg_end, e->ele);
+			}
+			if (e->start < p) {
+				e->len = p - e->start;
+				e = add_extent(idx, p, seg_end - p, NULL);
+			} else {
+				e->len = seg_end - p;
+				lru_bump(idx->lru, e->ele);
+			}
+		} else {
+			n = seg_end - p;
+			*misses += n;
+			// a run longer than the cache only leaves its tail behind
+			if (n > idx->max_blocks) {
+				p += n - idx->max_blocks;
+				n = idx->max_blocks;
+			}
+			if (n == 0) {
+				p = seg_end;
+				continue;
+			}
+			if (idx->nblocks + n > idx->max_blocks) {
+				evict(idx, idx->nblocks + n - idx->max_blocks);
+			}
+			e = add_extent(idx, p, n, NULL);
+			idx->nblocks += n;
+		}
+		if (e) {
+			merge_head(idx, e);
+		}
+		p = seg_end;
+	}
+}
+
+uint64 extent_num_blocks (struct extent_index *idx)
+{
+	return idx->nblocks;
+}
+
+uint32 extent_num_extents (struct extent_index *idx)
+{
+	return idx->lru->nelements;
+}
+
+void extent_destroy (struct extent_index *idx)
+{
+	if (idx == NULL) {
+		return;
+	}
+	hash_destroy(idx->chunks);
+	lru_destroy(idx->lru);
+	pool_destroy(idx->extent_pool);
+	pool_destroy(idx->chunk_pool);
+	free(idx);
+}
@@ -4,7 +4,45 @@
 #include "hash.h"
 #include <string.h>
 
-struct hash_table *hash_init(uint32 buckets, uint64 (*hash_func)(struct hash_table* table, uint64 key))
+#define IS_OPEN(table)	(((table)->flags & HASH_TYPE_MASK) == HASH_OPEN)
+#define DIST(slot)	((slot)->dist & ~HASH_SLOT_DELETED)
+
+#define HASH_MIN_BUCKETS	(8)
+/* buckets (chained) or slots (open) drained per insert/delete */
+#define HASH_REHASH_STEP	(4)
+#define HASH_REHASH_SLOTS	(16)
+#define HASH_REHASH_EMPTY	(10*HASH_REHASH_STEP)
+
+static uint32 round_pow2(uint32 n)
+{
+	uint32 size = HASH_MIN_BUCKETS;
+
+	while (size < n && size < 0x80000000) {
+		size <<= 1;
+	}
+	return size;
+}
+
+static uint32 alloc_buckets(struct hash_table *table, uint32 buckets,
+		struct hash_table_entries **entries, struct hash_slot **slots)
+{
+	if (IS_OPEN(table)) {
+		*slots = malloc(sizeof(struct hash_slot)*buckets);
+		if (*slots == NULL) {
+			return FAILURE;
+		}
+		memset(*slots, 0, sizeof(struct hash_slot)*buckets);
+		return SUCCESS;
+	}
+	*entries = malloc(sizeof(struct hash_table_entries)*buckets);
+	if (*entries == NULL) {
+		return FAILURE;
+	}
+	memset(*entries, 0, sizeof(struct hash_table_entries)*buckets);
+	return SUCCESS;
+}
+
+struct hash_table *hash_init(uint32 buckets, uint32 flags, uint64 (*hash_func)(struct hash_table* table, uint64 key))
 {
 	struct hash_table * table = malloc(sizeof(struct hash_table));
 	if (table == NULL) {
@@ -12,19 +50,99 @@ struct hash_table *hash_init(uint32 buckets, uint64 (*hash_func)(struct hash_tab
 	}
 	memset(table, 0, sizeof(*table));
 	table->hash_func = hash_func;
-	table->table = malloc(sizeof(struct hash_table_entries)*buckets);
-	if (table->table ==NULL) {
+	table->flags = flags;
+	table->num_tables = table->min_tables = round_pow2(buckets);
+	if (!alloc_buckets(table, table->num_tables, &table->table, &table->slots)) {
+		free(table);
+		return NULL;
+	}
+	if (IS_OPEN(table)) {
+		return table;
+	}
+	table->pool = pool_init(sizeof(struct hash), 0);
+	if (table->pool == NULL) {
+		free(table->table);
 		free(table);
 		return NULL;
 	}
-	table->num_tables = buckets;
-	memset(table->table, 0, sizeof(struct hash_table_entries)*buckets);
 	return table;
 }
 
-static struct hash * find_in_list(struct hash *h, uint64 key)
+/* ----------------------- open addressing ----------------------- */
+
+/*
+ * skip is the number of leading slots already drained out of an old
+ * table, entries found there are stale. probes is bumped by the number
+ * of slots looked at.
+ */
+static struct hash_slot * open_find(struct hash_slot *slots, uint32 size,
+		uint64 hash, uint64 key, uint32 skip, uint32 *probes)
+{
+	uint32 mask = size - 1;
+	uint32 i = hash & mask;
+	uint32 dist = 1;
+
+	while (DIST(&slots[i]) >= dist) {
+		if (slots[i].key == key && !(slots[i].dist & HASH_SLOT_DELETED)) {
+			*probes += dist;
+			return i < skip ? NULL : &slots[i];
+		}
+		dist++;
+		i = (i + 1) & mask;
+	}
+	*probes += dist;
+	return NULL;
+}
+
+static void open_place(struct hash_slot *slots, uint32 size, uint64 hash,
+		uint64 key, void *data, uint32 idx)
+{
+	struct hash_slot cur, tmp;
+	uint32 mask = size - 1;
+	uint32 i = hash & mask;
+
+	cur.key = key;
+	cur.data = data;
+	cur.dist = 1;
+	cur.idx = idx;
+	for (;;) {
+		if (slots[i].dist == 0) {
+			slots[i] = cur;
+			return;
+		}
+		// robin hood: the entry closer to its home gives up the slot
+		if (slots[i].dist < cur.dist) {
+			tmp = slots[i];
+			slots[i] = cur;
+			cur = tmp;
+		}
+		cur.dist++;
+		i = (i + 1) & mask;
+	}
+}
+
+static void open_remove(struct hash_slot *slots, uint32 size, struct hash_slot *slot)
+{
+	uint32 mask = size - 1;
+	uint32 i = slot - slots;
+	uint32 j = (i + 1) & mask;
+
+	// backward shift the following entries instead of leaving a tombstone
+	while (slots[j].dist > 1) {
+		slots[i] = slots[j];
+		slots[i].dist--;
+		i = j;
+		j = (j + 1) & mask;
+	}
+	slots[i].dist = 0;
+}
+
+/* ----------------------- chained ----------------------- */
+
+static struct hash * find_in_list(struct hash *h, uint64 key, uint32 *probes)
 {
 	while (h) {
+		(*probes)++;
 		if (h->key == key){
 			return h;
 		}
@@ -33,62 +151,480 @@ static struct hash * find_in_list(struct hash *h, uint64 key)
 	return NULL;
 }
 
+static struct hash * unlink_from_list(struct hash_table_entries *bucket, uint64 key, uint32 *probes)
+{
+	struct hash * hash = bucket->next;
+	struct hash * prev = NULL;
 
-uint32 hash_insert(struct hash_table* table, uint64 key, void* data)
+	while (hash && hash->key != key) {
+		(*probes)++;
+		prev = hash;
+		hash = hash->next;
+	}
+	if (hash) {
+		(*probes)++;
+	}
+	if (!hash) {
+		return NULL;
+	}
+	if (prev) {
+		prev->next = hash->next;
+	} else {
+		bucket->next = hash->next;
+	}
+	hash->next = NULL;
+	bucket->nelements--;
+	return hash;
+}
+
+/* ----------------------- resize ----------------------- */
+
+static void rehash_done(struct hash_table *table)
 {
+	free(table->old_table);
+	free(table->old_slots);
+	table->old_table = NULL;
+	table->old_slots = NULL;
+	table->old_num_tables = 0;
+	table->rehash_idx = 0;
+}
+
+static void rehash_step(struct hash_table *table, uint32 steps)
+{
+	struct hash_table_entries * bucket, * dest;
+	struct hash_slot * slot;
 	struct hash * hash;
-	//search in the list for this element
+	uint32 empty = HASH_REHASH_EMPTY;
+	uint32 mask = table->num_tables - 1;
 
-	if (find_in_list(table->table[table->hash_func(table, key)].next, key)) {
-		return FAILURE;
+	if (table->old_num_tables == 0) {
+		return;
 	}
-	hash = malloc(sizeof(struct hash));
-	hash->key = key;
-	hash->data = data;
-	hash->next = table->table[table->hash_func(table, key)].next;
-	table->table[table->hash_func(table, key)].next = hash;
-	table->table[table->hash_func(table, key)].nelements++;
-	table->nelements++;
+	if (IS_OPEN(table)) {
+		steps *= HASH_REHASH_SLOTS/HASH_REHASH_STEP;
+		while (steps-- && table->rehash_idx < table->old_num_tables) {
+			slot = &table->old_slots[table->rehash_idx++];
+			if (slot->dist && !(slot->dist & HASH_SLOT_DELETED)) {
+				open_place(table->slots, table->num_tables,
+					table->hash_func(table, slot->key), slot->key, slot->data, slot->idx);
+				table->stats.rehashed++;
+			}
+		}
+	} else {
+		while (steps && table->rehash_idx < table->old_num_tables) {
+			bucket = &table->old_table[table->rehash_idx++];
+			if (bucket->next == NULL) {
+				if (--empty == 0)	break;
+				continue;
+			}
+			while ((hash = bucket->next)) {
+				bucket->next = hash->next;
+				dest = &table->table[table->hash_func(table, hash->key) & mask];
+				hash->next = dest->next;
+				dest->next = hash;
+				dest->nelements++;
+				table->stats.rehashed++;
+			}
+			bucket->nelements = 0;
+			steps--;
+		}
+	}
+	if (table->rehash_idx == table->old_num_tables) {
+		rehash_done(table);
+	}
+}
+
+/* drains a resize in progress, for callers that walk the buckets */
+void hash_rehash_finish(struct hash_table *table)
+{
+	// a chained step gives up after a run of empty buckets
+	while (table->old_num_tables) {
+		rehash_step(table, table->old_num_tables);
+	}
+}
+
+static void resize(struct hash_table *table, uint32 buckets)
+{
+	struct hash_table_entries * entries = NULL;
+	struct hash_slot * slots = NULL;
+
+	if (table->old_num_tables || buckets == table->num_tables) {
+		return;
+	}
+	// on allocation failure just keep running at the current size
+	if (!alloc_buckets(table, buckets, &entries, &slots)) {
+		return;
+	}
+	table->old_table = table->table;
+	table->old_slots = table->slots;
+	table->old_num_tables = table->num_tables;
+	table->rehash_idx = 0;
+	table->table = entries;
+	table->slots = slots;
+	if (buckets > table->num_tables) {
+		table->stats.grows++;
+	} else {
+		table->stats.shrinks++;
+	}
+	table->num_tables = buckets;
+}
+
+/*
+ * chained tables grow past one element per bucket, open addressing past
+ * 3/4 full. both shrink below 1/8 but never under the initial size.
+ */
+static void resize_check(struct hash_table *table, uint32 nelements)
+{
+	if (IS_OPEN(table)) {
+		// the current table must never fill up while draining
+		if (table->old_num_tables && (uint64)nelements*10 > (uint64)table->num_tables*9) {
+			rehash_step(table, table->old_num_tables);
+		}
+		if ((uint64)nelements*4 > (uint64)table->num_tables*3) {
+			resize(table, table->num_tables << 1);
+			return;
+		}
+	} else if (nelements > table->num_tables) {
+		resize(table, table->num_tables << 1);
+		return;
+	}
+	if ((uint64)nelements*8 < table->num_tables && table->num_tables > table->min_tables) {
+		resize(table, table->num_tables >> 1);
+	}
+}
+
+/* ----------------------- sampling ----------------------- */
+
+/*
+ * HASH_SAMPLE tables also keep every element in a dense array, each
+ * chain node or slot remembers its position there. deletes move the last
+ * array entry into the hole, so the array stays dense and hash_get_nth
+ * is a plain index.
+ */
+static uint32 sample_add(struct hash_table *table, uint64 key, void *data)
+{
+	struct hash_dense * dense;
+	uint32 size;
+
+	if (table->ndense == table->dense_size) {
+		size = table->dense_size ? table->dense_size << 1 : table->min_tables;
+		dense = realloc(table->dense, sizeof(struct hash_dense)*size);
+		if (dense == NULL) {
+			return FAILURE;
+		}
+		table->dense = dense;
+		table->dense_size = size;
+	}
+	table->dense[table->ndense].key = key;
+	table->dense[table->ndense].data = data;
 	return SUCCESS;
 }
 
-uint32 hash_lookup(struct hash_table *table, uint64 key, void ** data)
+static uint32 * find_idx(struct hash_table *table, uint64 key)
 {
-	struct hash * hash = find_in_list(table->table[table->hash_func(table, key)].next, key);
-	if (hash) {
-		if (data)	*data = hash->data;
-		return SUCCESS;
+	struct hash_slot * slot = NULL;
+	struct hash * hash = NULL;
+	uint64 h = table->hash_func(table, key);
+	uint32 probes = 0;
+
+	if (IS_OPEN(table)) {
+		slot = open_find(table->slots, table->num_tables, h, key, 0, &probes);
+		if (!slot && table->old_slots) {
+			slot = open_find(table->old_slots, table->old_num_tables, h, key,
+					table->rehash_idx, &probes);
+		}
+		return slot ? &slot->idx : NULL;
+	}
+	hash = find_in_list(table->table[h & (table->num_tables - 1)].next, key, &probes);
+	if (!hash && table->old_table) {
+		hash = find_in_list(table->old_table[h & (table->old_num_tables - 1)].next, key, &probes);
+	}
+	return hash ? &hash->idx : NULL;
+}
+
+static void sample_remove(struct hash_table *table, uint32 idx)
+{
+	struct hash_dense * dense;
+	uint32 last = --table->ndense;
+
+	if (idx != last) {
+		table->dense[idx] = table->dense[last];
+		*find_idx(table, table->dense[idx].key) = idx;
+	}
+	if (table->ndense*4 < table->dense_size && table->dense_size > table->min_tables) {
+		dense = realloc(table->dense, sizeof(struct hash_dense)*(table->dense_size >> 1));
+		if (dense) {
+			table->dense = dense;
+			table->dense_size >>= 1;
+		}
+	}
+}
+
+/* ----------------------- probe counting ----------------------- */
+
+static void record_probes(struct hash_table *table, uint32 probes)
+{
+	table->stats.ops++;
+	table->stats.probes += probes;
+	table->stats.probe_hist[probes < HASH_STATS_HIST ? probes : HASH_STATS_HIST - 1]++;
+	if (probes > table->stats.max_probe) {
+		table->stats.max_probe = probes;
+	}
+}
+
+/* ----------------------- api ----------------------- */
+
+static uint32 lookup_hashed(struct hash_table *table, uint64 h, uint64 key, void ** data)
+{
+	struct hash_slot * slot = NULL;
+	struct hash * hash = NULL;
+	uint32 probes = 0;
+
+	if (IS_OPEN(table)) {
+		slot = open_find(table->slots, table->num_tables, h, key, 0, &probes);
+		if (!slot && table->old_slots) {
+			slot = open_find(table->old_slots, table->old_num_tables, h, key,
+					table->rehash_idx, &probes);
+		}
+		record_probes(table, probes);
+		if (slot) {
+			if (data)	*data = slot->data;
+			return SUCCESS;
+		}
 	} else {
-		*data = NULL;
+		hash = find_in_list(table->table[h & (table->num_tables - 1)].next, key, &probes);
+		if (!hash && table->old_table) {
+			hash = find_in_list(table->old_table[h & (table->old_num_tables - 1)].next, key, &probes);
+		}
+		record_probes(table, probes);
+		if (hash) {
+			if (data)	*data = hash->data;
+			return SUCCESS;
+		}
 	}
+	if (data)	*data = NULL;
 	return FAILURE;
 }
 
-uint32 hash_delete (struct hash_table*table,uint64 key, void ** data)
+uint32 hash_lookup(struct hash_table *table, uint64 key, void ** data)
 {
-	struct hash * hash = find_in_list(table->table[table->hash_func(table, key)].next, key);
-	struct hash *prev = NULL;
-	if (!hash) {
+	return lookup_hashed(table, table->hash_func(table, key), key, data);
+}
+
+/* one batch of at most HASH_BATCH keys already hashed */
+static uint32 lookup_prefetched(struct hash_table *table, uint64 *keys, uint64 *h, uint32 cnt, void ** data)
+{
+	uint32 j, found = 0;
+	uint32 mask = table->num_tables - 1;
+
+	for (j = 0; j < cnt; j++) {
+		if (IS_OPEN(table)) {
+			__builtin_prefetch(&table->slots[h[j] & mask]);
+		} else {
+			__builtin_prefetch(&table->table[h[j] & mask]);
+		}
+	}
+	// second level for chains, the first node of each bucket
+	if (!IS_OPEN(table)) {
+		for (j = 0; j < cnt; j++) {
+			__builtin_prefetch(table->table[h[j] & mask].next);
+		}
+	}
+	for (j = 0; j < cnt; j++) {
+		found += lookup_hashed(table, h[j], keys[j], &data[j]);
+	}
+	return found;
+}
+
+/*
+ * looks up n keys, data[i] is NULL for the keys not found. keys are
+ * hashed and their buckets prefetched a batch at a time before any of
+ * them is resolved, so the cache misses of the batch overlap.
+ * returns the number of keys found.
+ */
+uint32 hash_lookup_batch(struct hash_table* table, uint64 *keys, uint32 n, void ** data)
+{
+	uint64 h[HASH_BATCH];
+	uint32 i, j, cnt, found = 0;
+
+	for (i = 0; i < n; i += cnt) {
+		cnt = n - i < HASH_BATCH ? n - i : HASH_BATCH;
+		if (table->hash_batch) {
+			table->hash_batch(keys + i, cnt, h);
+		} else {
+			for (j = 0; j < cnt; j++) {
+				h[j] = table->hash_func(table, keys[i + j]);
+			}
+		}
+		found += lookup_prefetched(table, keys + i, h, cnt, data + i);
+	}
+	return found;
+}
+
+/* the same with hashes[i] = hash_func(keys[i]) worked out by the caller */
+uint32 hash_lookup_batch_hashed(struct hash_table* table, uint64 *keys, uint64 *hashes, uint32 n, void ** data)
+{
+	uint32 i, cnt, found = 0;
+
+	for (i = 0; i < n; i += cnt) {
+		cnt = n - i < HASH_BATCH ? n - i : HASH_BATCH;
+		found += lookup_prefetched(table, keys + i, hashes + i, cnt, data + i);
+	}
+	return found;
+}
+
+uint32 hash_insert(struct hash_table* table, uint64 key, void* data)
+{
+	struct hash * hash;
+	uint64 h;
+	uint32 mask;
+
+	rehash_step(table, HASH_REHASH_STEP);
+	h = table->hash_func(table, key);
+	//search in the tables for this element
+	if (lookup_hashed(table, h, key, NULL)) {
+		return FAILURE;
+	}
+	if ((table->flags & HASH_SAMPLE) && !sample_add(table, key, data)) {
+		return FAILURE;
+	}
+	if (IS_OPEN(table)) {
+		resize_check(table, table->nelements + 1);
+		// keep one slot free so that probing always terminates
+		if (table->nelements + 1 >= table->num_tables) {
+			return FAILURE;
+		}
+		open_place(table->slots, table->num_tables, h, key, data, table->ndense);
+		table->nelements++;
+		if (table->flags & HASH_SAMPLE)	table->ndense++;
+		return SUCCESS;
+	}
+	hash = pool_alloc(table->pool);
+	if (hash == NULL) {
 		return FAILURE;
 	}
-	if (hash == table->table[table->hash_func(table, key)].next) {
-		table->table[table->hash_func(table, key)].next = hash->next;
+	if (table->flags & HASH_SAMPLE)	table->ndense++;
+	mask = table->num_tables - 1;
+	hash->key = key;
+	hash->data = data;
+	hash->idx = table->ndense - 1;
+	hash->next = table->table[h & mask].next;
+	table->table[h & mask].next = hash;
+	table->table[h & mask].nelements++;
+	table->nelements++;
+	resize_check(table, table->nelements);
+	return SUCCESS;
+}
+
+static uint32 delete_hashed(struct hash_table *table, uint64 h, uint64 key, void ** data)
+{
+	struct hash_slot * slot;
+	struct hash * hash;
+	uint32 probes = 0;
+	uint32 idx;
+	int old = 0;
+
+	rehash_step(table, HASH_REHASH_STEP);
+	if (IS_OPEN(table)) {
+		slot = open_find(table->slots, table->num_tables, h, key, 0, &probes);
+		if (!slot && table->old_slots) {
+			slot = open_find(table->old_slots, table->old_num_tables, h, key,
+					table->rehash_idx, &probes);
+			old = 1;
+		}
+		record_probes(table, probes);
+		if (!slot) {
+			return FAILURE;
+		}
+		if (data)	*data = slot->data;
+		idx = slot->idx;
+		if (!old) {
+			open_remove(table->slots, table->num_tables, slot);
+		} else {
+			// the old table is read only, just mark the entry
+			slot->dist |= HASH_SLOT_DELETED;
+		}
 	} else {
-		prev = table->table[table->hash_func(table, key)].next;
-		while (prev->next != hash) {
-			prev = prev->next;
+		hash = unlink_from_list(&table->table[h & (table->num_tables - 1)], key, &probes);
+		if (!hash && table->old_table) {
+			hash = unlink_from_list(&table->old_table[h & (table->old_num_tables - 1)], key, &probes);
 		}
-		prev->next = hash->next;
-		hash->next = NULL;
+		record_probes(table, probes);
+		if (!hash) {
+			return FAILURE;
+		}
+		if (data)
+			*data = hash->data;
+		idx = hash->idx;
+		pool_free(table->pool, hash);
+	}
+	if (table->flags & HASH_SAMPLE) {
+		sample_remove(table, idx);
 	}
-	table->table[table->hash_func(table, key)].nelements--;
 	table->nelements--;
-	if (data)
-		*data = hash->data;
-	free(hash);
+	resize_check(table, table->nelements);
 	return SUCCESS;
 }
 
+uint32 hash_delete (struct hash_table*table,uint64 key, void ** data)
+{
+	return delete_hashed(table, table->hash_func(table, key), key, data);
+}
+
+/*
+ * deletes n keys, prefetching their buckets a batch at a time like
+ * hash_lookup_batch. returns the number deleted.
+ */
+uint32 hash_delete_batch(struct hash_table* table, uint64 *keys, uint32 n)
+{
+	uint64 h[HASH_BATCH];
+	uint32 i, j, cnt, deleted = 0;
+	uint32 mask;
+
+	for (i = 0; i < n; i += cnt) {
+		cnt = n - i < HASH_BATCH ? n - i : HASH_BATCH;
+		// the table may have resized during the previous round
+		mask = table->num_tables - 1;
+		if (table->hash_batch) {
+			table->hash_batch(keys + i, cnt, h);
+		}
+		for (j = 0; j < cnt; j++) {
+			if (!table->hash_batch) {
+				h[j] = table->hash_func(table, keys[i + j]);
+			}
+			if (IS_OPEN(table)) {
+				__builtin_prefetch(&table->slots[h[j] & mask]);
+			} else {
+				__builtin_prefetch(&table->table[h[j] & mask]);
+			}
+		}
+		if (!IS_OPEN(table)) {
+			for (j = 0; j < cnt; j++) {
+				__builtin_prefetch(table->table[h[j] & mask].next);
+			}
+		}
+		for (j = 0; j < cnt; j++) {
+			deleted += delete_hashed(table, h[j], keys[i + j], NULL);
+		}
+	}
+	return deleted;
+}
+
+void hash_destroy(struct hash_table *table)
+{
+	if (table == NULL) {
+		return;
+	}
+	// chain nodes all live in the pool, no need to walk the buckets
+	pool_destroy(table->pool);
+	free(table->table);
+	free(table->slots);
+	free(table->old_table);
+	free(table->old_slots);
+	free(table->dense);
+	free(table);
+}
+
 uint32 hash_num_elements (struct hash_table*table)
 {
 	return table->nelements;
@@ -96,6 +632,178 @@ uint32 hash_num_elements (struct hash_table*table)
 
 uint32 hash_num_elements_bucket(struct hash_table*table , uint32 bucket)
 {
+	if (IS_OPEN(table)) {
+		return table->slots[bucket].dist ? 1 : 0;
+	}
 	return table->table[bucket].nelements;
 }
 
+static uint32 nth_in_chains(struct hash_table_entries *entries, uint32 size,
+		uint32 *n, uint64 *key, void **data)
+{
+	struct hash * hash;
+	uint32 i;
+
+	for (i = 0; i < size; i++) {
+		if (*n >= entries[i].nelements) {
+			*n -= entries[i].nelements;
+			continue;
+		}
+		hash = entries[i].next;
+		while ((*n)--) {
+			hash = hash->next;
+		}
+		if (key)	*key = hash->key;
+		if (data)	*data = hash->data;
+		return SUCCESS;
+	}
+	return FAILURE;
+}
+
+static uint32 nth_in_slots(struct hash_slot *slots, uint32 start, uint32 size,
+		uint32 *n, uint64 *key, void **data)
+{
+	uint32 i;
+
+	for (i = start; i < size; i++) {
+		if (slots[i].dist && !(slots[i].dist & HASH_SLOT_DELETED) && (*n)-- == 0) {
+			if (key)	*key = slots[i].key;
+			if (data)	*data = slots[i].data;
+			return SUCCESS;
+		}
+	}
+	return FAILURE;
+}
+
+/*
+ * returns the n'th (0 based) element in bucket order, the part of the
+ * old table not yet drained comes first. HASH_SAMPLE tables return it
+ * in O(1) from the dense array, in no particular order.
+ */
+uint32 hash_get_nth(struct hash_table *table, uint32 n, uint64 *key, void ** data)
+{
+	if (n >= table->nelements) {
+		return FAILURE;
+	}
+	if (table->flags & HASH_SAMPLE) {
+		if (key)	*key = table->dense[n].key;
+		if (data)	*data = table->dense[n].data;
+		return SUCCESS;
+	}
+	if (IS_OPEN(table)) {
+		if (table->old_slots && nth_in_slots(table->old_slots, table->rehash_idx,
+					table->old_num_tables, &n, key, data)) {
+			return SUCCESS;
+		}
+		return nth_in_slots(table->slots, 0, table->num_tables, &n, key, data);
+	}
+	if (table->old_table && nth_in_chains(table->old_table, table->old_num_tables,
+				&n, key, data)) {
+		return SUCCESS;
+	}
+	return nth_in_chains(table->table, table->num_tables, &n, key, data);
+}
+
+/* ----------------------- stats ----------------------- */
+
+/*
+ * bytes held by the table: the bucket arrays (both while draining), the
+ * chain node pool and the table itself.
+ */
+uint64 hash_memory(struct hash_table *table)
+{
+	uint64 bytes = sizeof(*table);
+
+	if (IS_OPEN(table)) {
+		bytes += (uint64)sizeof(struct hash_slot)*table->num_tables;
+		if (table->old_slots)
+			bytes += (uint64)sizeof(struct hash_slot)*table->old_num_tables;
+	} else {
+		bytes += (uint64)sizeof(struct hash_table_entries)*table->num_tables;
+		if (table->old_table)
+			bytes += (uint64)sizeof(struct hash_table_entries)*table->old_num_tables;
+	}
+	if (table->pool)
+		bytes += pool_bytes(table->pool);
+	bytes += (uint64)sizeof(struct hash_dense)*table->dense_size;
+	return bytes;
+}
+
+static void dump_hist(FILE *fp, const char *name, uint64 *hist, uint32 n)
+{
+	uint32 i;
+
+	fprintf(fp, "  \"%s\": [", name);
+	for (i = 0; i < n; i++) {
+		fprintf(fp, "%s%llu", i ? ", " : "", (unsigned long long)hist[i]);
+	}
+	fprintf(fp, "],\n");
+}
+
+static void add_occupancy(struct hash_table *table, struct hash_table_entries *entries,
+		struct hash_slot *slots, uint32 from, uint32 to, uint64 *hist, uint32 *max)
+{
+	uint32 i, len;
+
+	for (i = from; i < to; i++) {
+		if (IS_OPEN(table)) {
+			if (!slots[i].dist)
+				continue;
+			len = DIST(&slots[i]) - 1;
+		} else {
+			len = entries[i].nelements;
+		}
+		if (len > *max)
+			*max = len;
+		hist[len < HASH_STATS_HIST ? len : HASH_STATS_HIST - 1]++;
+	}
+}
+
+/*
+ * current occupancy of the table: chain lengths per bucket for chained
+ * tables, probe distance per element for open ones. while resizing, the
+ * old buckets not drained yet count too.
+ */
+static uint32 occupancy_hist(struct hash_table *table, uint64 *hist)
+{
+	uint32 max = 0;
+
+	memset(hist, 0, sizeof(uint64)*HASH_STATS_HIST);
+	add_occupancy(table, table->table, table->slots, 0, table->num_tables, hist, &max);
+	if (table->old_num_tables) {
+		add_occupancy(table, table->old_table, table->old_slots,
+				table->rehash_idx, table->old_num_tables, hist, &max);
+	}
+	return max;
+}
+
+void hash_stats_dump_json(struct hash_table *table, FILE *fp)
+{
+	struct hash_stats *st = &table->stats;
+	uint64 hist[HASH_STATS_HIST];
+	uint64 bytes = hash_memory(table);
+	uint32 max;
+
+	max = occupancy_hist(table, hist);
+	fprintf(fp, "{\n");
+	fprintf(fp, "  \"type\": \"%s\",\n", IS_OPEN(table) ? "open" : "chained");
+	fprintf(fp, "  \"buckets\": %u,\n", table->num_tables);
+	fprintf(fp, "  \"elements\": %u,\n", table->nelements);
+	fprintf(fp, "  \"load_factor\": %.4f,\n", (double)table->nelements/table->num_tables);
+	fprintf(fp, "  \"rehashing\": %s,\n",
+			(table->old_table || table->old_slots) ? "true" : "false");
+	fprintf(fp, "  \"ops\": %llu,\n", (unsigned long long)st->ops);
+	fprintf(fp, "  \"probes\": %llu,\n", (unsigned long long)st->probes);
+	fprintf(fp, "  \"probes_per_op\": %.4f,\n", st->ops ? (double)st->probes/st->ops : 0.0);
+	dump_hist(fp, "probe_hist", st->probe_hist, HASH_STATS_HIST);
+	fprintf(fp, "  \"max_probe\": %u,\n", st->max_probe);
+	fprintf(fp, "  \"grows\": %u,\n", st->grows);
+	fprintf(fp, "  \"shrinks\": %u,\n", st->shrinks);
+	fprintf(fp, "  \"rehashed\": %llu,\n", (unsigned long long)st->rehashed);
+	dump_hist(fp, IS_OPEN(table) ? "displacement_hist" : "chain_hist", hist, HASH_STATS_HIST);
+	fprintf(fp, "  \"%s\": %u,\n", IS_OPEN(table) ? "max_displacement" : "max_chain", max);
+	fprintf(fp, "  \"memory_bytes\": %llu,\n", (unsigned long long)bytes);
+	fprintf(fp, "  \"bytes_per_element\": %.2f\n",
+			table->nelements ? (double)bytes/table->nelements : 0.0);
+	fprintf(fp, "}\n");
+}
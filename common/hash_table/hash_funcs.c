@@ -0,0 +1,194 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+#include "hash_funcs.h"
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#define FIB_MULT	0x9e3779b97f4a7c15ULL
+#define MURMUR_M1	0xff51afd7ed558ccdULL
+#define MURMUR_M2	0xc4ceb9fe1a85ec53ULL
+#define XXH_P1	0x9e3779b185ebca87ULL
+#define XXH_P2	0xc2b2ae3d27d4eb4fULL
+#define XXH_P3	0x165667b19e3779f9ULL
+#define XXH_P4	0x85ebca77c2b2ae63ULL
+#define XXH_P5	0x27d4eb2f165667c5ULL
+#define WY_P0	0xa0761d6478bd642fULL
+#define WY_P1	0xe7037ed1a0b428dbULL
+
+#define ROTL(x, r)	(((x) << (r)) | ((x) >> (64 - (r))))
+
+/* the key itself, fine for chains but strided keys only hit some buckets */
+uint64 hash_identity(struct hash_table *table, uint64 key)
+{
+	return key;
+}
+
+/*
+ * fibonacci hashing. the well mixed bits of the product are the top
+ * ones, byte swap them down to where the table mask looks.
+ */
+uint64 hash_fib(struct hash_table *table, uint64 key)
+{
+	return __builtin_bswap64(key*FIB_MULT);
+}
+
+/* murmur3 fmix64 finalizer */
+uint64 hash_murmur(struct hash_table *table, uint64 key)
+{
+	key ^= key >> 33;
+	key *= MURMUR_M1;
+	key ^= key >> 33;
+	key *= MURMUR_M2;
+	key ^= key >> 33;
+	return key;
+}
+
+/* xxh64 of the 8 byte key, seed 0 */
+uint64 hash_xxh64(struct hash_table *table, uint64 key)
+{
+	uint64 h = XXH_P5 + 8;
+	uint64 k = key*XXH_P2;
+
+	k = ROTL(k, 31)*XXH_P1;
+	h ^= k;
+	h = ROTL(h, 27)*XXH_P1 + XXH_P4;
+	h ^= h >> 33;
+	h *= XXH_P2;
+	h ^= h >> 29;
+	h *= XXH_P3;
+	h ^= h >> 32;
+	return h;
+}
+
+/* wyhash style 128 bit multiply and fold */
+uint64 hash_wy(struct hash_table *table, uint64 key)
+{
+	__uint128_t r = (__uint128_t)(key ^ WY_P0)*WY_P1;
+
+	return (uint64)r ^ (uint64)(r >> 64);
+}
+
+#define SCALAR_BATCH(name, func)					\
+static void name(uint64 *keys, uint32 n, uint64 *out)			\
+{									\
+	uint32 i;							\
+	for (i = 0; i < n; i++) {					\
+		out[i] = func(NULL, keys[i]);				\
+	}								\
+}
+
+SCALAR_BATCH(identity_batch, hash_identity)
+SCALAR_BATCH(fib_batch, hash_fib)
+SCALAR_BATCH(murmur_batch, hash_murmur)
+SCALAR_BATCH(xxh64_batch, hash_xxh64)
+SCALAR_BATCH(wy_batch, hash_wy)
+
+#if defined(__x86_64__)
+/*
+ * AVX2 has no 64 bit multiply, build the low 64 bits of the product
+ * from three 32x32 multiplies. that makes xxh64 (five multiplies) slower
+ * than scalar, so only fib and murmur get a vector version.
+ */
+__attribute__((target("avx2")))
+static inline __m256i mul64(__m256i a, __m256i b)
+{
+	__m256i lo = _mm256_mul_epu32(a, b);
+	__m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b),
+			_mm256_mul_epu32(a, _mm256_srli_epi64(b, 32)));
+
+	return _mm256_add_epi64(lo, _mm256_slli_epi64(cross, 32));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i xorshift(__m256i x, int r)
+{
+	return _mm256_xor_si256(x, _mm256_srli_epi64(x, r));
+}
+
+__attribute__((target("avx2")))
+static void fib_batch_avx2(uint64 *keys, uint32 n, uint64 *out)
+{
+	__m256i m = _mm256_set1_epi64x(FIB_MULT);
+	__m256i bswap = _mm256_set_epi8(8, 9, 10, 11, 12, 13, 14, 15,
+			0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+			0, 1, 2, 3, 4, 5, 6, 7);
+	__m256i x;
+	uint32 i;
+
+	for (i = 0; i + 4 <= n; i += 4) {
+		x = _mm256_loadu_si256((__m256i *)&keys[i]);
+		x = _mm256_shuffle_epi8(mul64(x, m), bswap);
+		_mm256_storeu_si256((__m256i *)&out[i], x);
+	}
+	fib_batch(keys + i, n - i, out + i);
+}
+
+__attribute__((target("avx2")))
+static void murmur_batch_avx2(uint64 *keys, uint32 n, uint64 *out)
+{
+	__m256i m1 = _mm256_set1_epi64x(MURMUR_M1);
+	__m256i m2 = _mm256_set1_epi64x(MURMUR_M2);
+	__m256i x;
+	uint32 i;
+
+	for (i = 0; i + 4 <= n; i += 4) {
+		x = _mm256_loadu_si256((__m256i *)&keys[i]);
+		x = mul64(xorshift(x, 33), m1);
+		x = mul64(xorshift(x, 33), m2);
+		x = xorshift(x, 33);
+		_mm256_storeu_si256((__m256i *)&out[i], x);
+	}
+	murmur_batch(keys + i, n - i, out + i);
+}
+#endif
+
+struct hash_func_desc hash_funcs[] = {
+	{"identity",	hash_identity,	identity_batch},
+	{"fib",		hash_fib,	fib_batch},
+	{"murmur",	hash_murmur,	murmur_batch},
+	{"xxh64",	hash_xxh64,	xxh64_batch},
+	{"wy",		hash_wy,	wy_batch},
+	{NULL, NULL, NULL}
+};
+
+static void hash_funcs_init(void)
+{
+	static int done = 0;
+
+	if (done) {
+		return;
+	}
+	done = 1;
+#if defined(__x86_64__)
+	if (__builtin_cpu_supports("avx2")) {
+		hash_funcs[1].batch = fib_batch_avx2;
+		hash_funcs[2].batch = murmur_batch_avx2;
+	}
+#endif
+}
+
+struct hash_func_desc * hash_func_find(const char *name)
+{
+	struct hash_func_desc * desc;
+
+	hash_funcs_init();
+	for (desc = hash_funcs; desc->name; desc++) {
+		if (!strcmp(desc->name, name)) {
+			return desc;
+		}
+	}
+	return NULL;
+}
+
+void hash_func_list(FILE *fp)
+{
+	struct hash_func_desc * desc;
+
+	for (desc = hash_funcs; desc->name; desc++) {
+		fprintf(fp, "%s%s", desc == hash_funcs ? "" : " ", desc->name);
+	}
+	fprintf(fp, "\n");
+}
@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+#include "packed_hash.h"
+#include "prng.h"
+
+static uint32 home(struct packed_table *pt, uint64 key)
+{
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdULL;
+	key ^= key >> 33;
+	return key & (pt->size - 1);
+}
+
+struct packed_table *packed_init(uint32 max_elements)
+{
+	struct packed_table * pt = malloc(sizeof(*pt));
+	uint64 size = 8;
+
+	if (pt == NULL) {
+		return NULL;
+	}
+	memset(pt, 0, sizeof(*pt));
+	while (size*3 < (uint64)max_elements*4) {
+		size <<= 1;
+	}
+	if (size > 0x80000000ULL) {
+		free(pt);
+		return NULL;
+	}
+	pt->size = size;
+	pt->slots = malloc(sizeof(uint64)*size);
+	if (pt->slots == NULL) {
+		free(pt);
+		return NULL;
+	}
+	memset(pt->slots, 0xFF, sizeof(uint64)*size);
+	return pt;
+}
+
+uint32 packed_lookup(struct packed_table *pt, uint64 key)
+{
+	uint32 i = home(pt, key);
+
+	while (pt->slots[i] != PACKED_EMPTY) {
+		if (PACKED_KEY(pt->slots[i]) == key) {
+			return i;
+		}
+		i = (i + 1) & (pt->size - 1);
+	}
+	return PACKED_NONE;
+}
+
+uint32 packed_insert(struct packed_table *pt, uint64 key, uint32 val)
+{
+	uint32 i;
+
+	// the all ones key is the empty marker
+	if (key >= PACKED_KEY_MASK || val > 0xFFFF || pt->nelements + 1 >= pt->size) {
+		return FAILURE;
+	}
+	if (packed_lookup(pt, key) != PACKED_NONE) {
+		return FAILURE;
+	}
+	i = home(pt, key);
+	while (pt->slots[i] != PACKED_EMPTY) {
+		i = (i + 1) & (pt->size - 1);
+	}
+	pt->slots[i] = key | ((uint64)val << PACKED_KEY_BITS);
+	pt->nelements++;
+	return SUCCESS;
+}
+
+void packed_set_val(struct packed_table *pt, uint32 slot, uint32 val)
+{
+	pt->slots[slot] = PACKED_KEY(pt->slots[slot]) | ((uint64)(val & 0xFFFF) << PACKED_KEY_BITS);
+}
+
+void packed_delete(struct packed_table *pt, uint32 slot)
+{
+	uint32 mask = pt->size - 1;
+	uint32 i = slot, j = slot, h;
+
+	// backward shift: pull later entries of the run into the hole
+	for (;;) {
+		j = (j + 1) & mask;
+		if (pt->slots[j] == PACKED_EMPTY) {
+			break;
+		}
+		h = home(pt, PACKED_KEY(pt->slots[j]));
+		// j stays if its home lies cyclically in (i, j]
+		if (i <= j ? (i < h && h <= j) : (i < h || h <= j)) {
+			continue;
+		}
+		pt->slots[i] = pt->slots[j];
+		i = j;
+	}
+	pt->slots[i] = PACKED_EMPTY;
+	pt->nelements--;
+}
+
+uint32 packed_sample(struct packed_table *pt, uint64 *seed)
+{
+	uint32 i;
+
+	if (pt->nelements == 0) {
+		return PACKED_NONE;
+	}
+	// at least a quarter of the slots are used, a few tries on average
+	do {
+		i = (prng_next(seed) >> 32) & (pt->size - 1);
+	} while (pt->slots[i] == PACKED_EMPTY);
+	return i;
+}
+
+uint64 packed_memory(struct packed_table *pt)
+{
+	return sizeof(*pt) + (uint64)sizeof(uint64)*pt->size;
+}
+
+void packed_destroy(struct packed_table *pt)
+{
+	if (pt == NULL) {
+		return;
+	}
+	free(pt->slots);
+	free(pt);
+}
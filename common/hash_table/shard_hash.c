@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+#include "shard_hash.h"
+
+struct shard_hash *shard_hash_init(uint32 nshards, uint32 buckets, uint32 flags, uint64 (*hash_func)(struct hash_table*table, uint64 key))
+{
+	struct shard_hash * sh = malloc(sizeof(*sh));
+	uint32 i;
+
+	if (sh == NULL) {
+		return NULL;
+	}
+	memset(sh, 0, sizeof(*sh));
+	// power of two so the shard is a mask of the hash
+	sh->nshards = 1;
+	while (sh->nshards < nshards) {
+		sh->nshards <<= 1;
+	}
+	sh->hash_func = hash_func;
+	if (posix_memalign((void **)&sh->shards, SHARD_CACHELINE,
+				sizeof(struct hash_shard)*sh->nshards)) {
+		free(sh);
+		return NULL;
+	}
+	memset(sh->shards, 0, sizeof(struct hash_shard)*sh->nshards);
+	for (i = 0; i < sh->nshards; i++) {
+		pthread_mutex_init(&sh->shards[i].lock, NULL);
+		sh->shards[i].table = hash_init(buckets/sh->nshards, flags, hash_func);
+		if (sh->shards[i].table == NULL) {
+			shard_hash_destroy(sh);
+			return NULL;
+		}
+	}
+	return sh;
+}
+
+/*
+ * the per shard tables use the low bits of the hash, so pick the shard
+ * from a scrambled copy of it.
+ */
+static struct hash_shard * get_shard(struct shard_hash *sh, uint64 key)
+{
+	uint64 h = sh->hash_func(NULL, key);
+
+	h ^= h >> 31;
+	h *= 0x9e3779b97f4a7c15ULL;
+	return &sh->shards[(h >> 32) & (sh->nshards - 1)];
+}
+
+uint32 shard_hash_insert(struct shard_hash *sh, uint64 key, void *data)
+{
+	struct hash_shard * shard = get_shard(sh, key);
+	uint32 ret;
+
+	pthread_mutex_lock(&shard->lock);
+	ret = hash_insert(shard->table, key, data);
+	pthread_mutex_unlock(&shard->lock);
+	return ret;
+}
+
+uint32 shard_hash_lookup(struct shard_hash *sh, uint64 key, void **data)
+{
+	struct hash_shard * shard = get_shard(sh, key);
+	uint32 ret;
+
+	pthread_mutex_lock(&shard->lock);
+	ret = hash_lookup(shard->table, key, data);
+	pthread_mutex_unlock(&shard->lock);
+	return ret;
+}
+
+uint32 shard_hash_delete(struct shard_hash *sh, uint64 key, void **data)
+{
+	struct hash_shard * shard = get_shard(sh, key);
+	uint32 ret;
+
+	pthread_mutex_lock(&shard->lock);
+	ret = hash_delete(shard->table, key, data);
+	pthread_mutex_unlock(&shard->lock);
+	return ret;
+}
+
+uint64 shard_hash_num_elements(struct shard_hash *sh)
+{
+	uint64 total = 0;
+	uint32 i;
+
+	for (i = 0; i < sh->nshards; i++) {
+		pthread_mutex_lock(&sh->shards[i].lock);
+		total += hash_num_elements(sh->shards[i].table);
+		pthread_mutex_unlock(&sh->shards[i].lock);
+	}
+	return total;
+}
+
+void shard_hash_destroy(struct shard_hash *sh)
+{
+	uint32 i;
+
+	if (sh == NULL) {
+		return;
+	}
+	for (i = 0; i < sh->nshards; i++) {
+		hash_destroy(sh->shards[i].table);
+		pthread_mutex_destroy(&sh->shards[i].lock);
+	}
+	free(sh->shards);
+	free(sh);
+}
@@ -0,0 +1,185 @@
+
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+#include "hash_funcs.h"
+#include "lirs.h"
+
+#define S_ELE(node)	dlist_entry(node, struct lirs_ele, s)
+#define Q_ELE(node)	dlist_entry(node, struct lirs_ele, q)
+
+/* drops a non resident block for good */
+static void forget(struct lirs *lirs, struct lirs_ele *ele)
+{
+	if (ele->flags & LIRS_IN_S) {
+		dlist_remove(&lirs->s, &ele->s);
+	}
+	dlist_remove(&lirs->ghost_fifo, &ele->q);
+	hash_delete(lirs->ghosts, ele->key, NULL);
+	pool_free(lirs->pool, ele);
+}
+
+/* the bottom of s is always a lir block */
+static void prune(struct lirs *lirs)
+{
+	struct lirs_ele * ele;
+
+	while (lirs->s.tail && !(S_ELE(lirs->s.tail)->flags & LIRS_LIR)) {
+		ele = S_ELE(lirs->s.tail);
+		dlist_remove(&lirs->s, &ele->s);
+		ele->flags &= ~LIRS_IN_S;
+		if (!(ele->flags & LIRS_RESIDENT)) {
+			forget(lirs, ele);
+		}
+	}
+}
+
+/* the lir block with the longest recency goes hir, to the end of q */
+static void demote_bottom(struct lirs *lirs)
+{
+	struct lirs_ele * ele;
+
+	// with no lir blocks before (a one block cache) s was never pruned
+	prune(lirs);
+	ele = S_ELE(lirs->s.tail);
+	dlist_remove(&lirs->s, &ele->s);
+	ele->flags &= ~(LIRS_LIR | LIRS_IN_S);
+	lirs->nlir--;
+	dlist_push_head(&lirs->q, &ele->q);
+	prune(lirs);
+}
+
+static void make_lir(struct lirs *lirs, struct lirs_ele *ele)
+{
+	ele->flags |= LIRS_LIR;
+	lirs->nlir++;
+	if (ele->flags & LIRS_IN_S) {
+		dlist_move_head(&lirs->s, &ele->s);
+	} else {
+		ele->flags |= LIRS_IN_S;
+		dlist_push_head(&lirs->s, &ele->s);
+	}
+}
+
+static void evict(struct lirs *lirs, uint64 *removed_key)
+{
+	struct lirs_ele * ele = Q_ELE(lirs->q.tail);
+
+	*removed_key = ele->key;
+	dlist_remove(&lirs->q, &ele->q);
+	if (!(ele->flags & LIRS_IN_S)) {
+		pool_free(lirs->pool, ele);
+		return;
+	}
+	ele->flags &= ~LIRS_RESIDENT;
+	dlist_push_head(&lirs->ghost_fifo, &ele->q);
+	hash_insert(lirs->ghosts, ele->key, ele);
+	if (lirs->ghost_fifo.n > lirs->max_elements) {
+		forget(lirs, Q_ELE(lirs->ghost_fifo.tail));
+	}
+}
+
+struct lirs * lirs_init (uint32 max_elements)
+{
+	struct lirs * lirs;
+	uint32 hir;
+
+	if (max_elements == 0) {
+		return NULL;
+	}
+	lirs = malloc(sizeof(*lirs));
+	if (lirs == NULL) {
+		return NULL;
+	}
+	memset(lirs, 0, sizeof(*lirs));
+	lirs->max_elements = max_elements;
+	hir = max_elements/100 ? max_elements/100 : 1;
+	lirs->lir_max = max_elements - hir;
+	lirs->pool = pool_init(sizeof(struct lirs_ele), 0);
+	lirs->ghosts = hash_init(1024, HASH_OPEN, hash_murmur);
+	if (lirs->pool == NULL || lirs->ghosts == NULL) {
+		lirs_destroy(lirs);
+		return NULL;
+	}
+	return lirs;
+}
+
+struct lirs_ele* lirs_insert (struct lirs *lirs, uint64 key, uint64 *removed_key)
+{
+	struct lirs_ele * ele;
+	void * data;
+
+	*removed_key = INVALID_KEY;
+	if (lirs_num_elements(lirs) == lirs->max_elements) {
+		evict(lirs, removed_key);
+	}
+	if (hash_delete(lirs->ghosts, key, &data)) {
+		// reused while still on s: short reuse distance, it goes lir
+		ele = data;
+		dlist_remove(&lirs->ghost_fifo, &ele->q);
+		ele->flags |= LIRS_RESIDENT;
+		make_lir(lirs, ele);
+		if (lirs->nlir > lirs->lir_max) {
+			demote_bottom(lirs);
+		}
+		return ele;
+	}
+	ele = pool_alloc(lirs->pool);
+	if (ele == NULL) {
+		return NULL;
+	}
+	ele->key = key;
+	ele->flags = LIRS_RESIDENT;
+	if (lirs->nlir < lirs->lir_max) {
+		// warming up, the first blocks all go lir
+		make_lir(lirs, ele);
+		return ele;
+	}
+	ele->flags |= LIRS_IN_S;
+	dlist_push_head(&lirs->s, &ele->s);
+	dlist_push_head(&lirs->q, &ele->q);
+	return ele;
+}
+
+uint32 lirs_bump (struct lirs *lirs, struct lirs_ele *ele)
+{
+	if (ele->flags & LIRS_LIR) {
+		if (lirs->s.tail == &ele->s) {
+			dlist_move_head(&lirs->s, &ele->s);
+			prune(lirs);
+		} else {
+			dlist_move_head(&lirs->s, &ele->s);
+		}
+		return SUCCESS;
+	}
+	if (ele->flags & LIRS_IN_S) {
+		dlist_remove(&lirs->q, &ele->q);
+		make_lir(lirs, ele);
+		demote_bottom(lirs);
+		return SUCCESS;
+	}
+	ele->flags |= LIRS_IN_S;
+	dlist_push_head(&lirs->s, &ele->s);
+	dlist_move_head(&lirs->q, &ele->q);
+	return SUCCESS;
+}
+
+uint32 lirs_num_elements (struct lirs *lirs)
+{
+	return lirs->nlir + lirs->q.n;
+}
+
+uint64 lirs_memory (struct lirs *lirs)
+{
+	return sizeof(*lirs) + pool_bytes(lirs->pool) + hash_memory(lirs->ghosts);
+}
+
+void lirs_destroy (struct lirs *lirs)
+{
+	if (lirs == NULL) {
+		return;
+	}
+	pool_destroy(lirs->pool);
+	hash_destroy(lirs->ghosts);
+	free(lirs);
+}
@@ -0,0 +1,281 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+#include "lowmem_lru.h"
+#include "prng.h"
+
+#define NUM_BUCKETS	(1024)
+#define TAG_COUNT(lru, tag)	((lru)->tagRing[(tag) & ((lru)->tagRingSize - 1)])
+
+struct lowmemlru * lowmemlru_init (uint32 lruPct, uint32 lruSizeInBlks, uint32 flags,
+		uint64 (*hash_func)(struct hash_table*table, uint64 key))
+{
+	struct lowmemlru * llru = malloc(sizeof(struct lowmemlru));
+	uint32 tags;
+
+	if (llru == NULL) {
+		return NULL;
+	}
+	memset((void *)llru, 0, sizeof(struct lowmemlru));
+	llru->bumpupCounter = ((lruPct*lruSizeInBlks)/100)/2;
+	llru->lowmemblks = ((lruPct*lruSizeInBlks)/100);
+	if (llru->bumpupCounter == 0)	llru->bumpupCounter = 1;
+	if (llru->lowmemblks == 0)	llru->lowmemblks = 1;
+	llru->cacheSize = lruSizeInBlks;
+	/*
+	 * a cache full of blocks spans about cacheSize/bumpupCounter tags,
+	 * twice that plus the oldest group is plenty, the oldest tags get
+	 * folded together if it ever runs out.
+	 */
+	tags = 2*(lruSizeInBlks/llru->bumpupCounter) + 4;
+	llru->tagRingSize = 1;
+	while (llru->tagRingSize < tags) {
+		llru->tagRingSize <<= 1;
+	}
+	llru->tagRing = malloc(sizeof(uint32)*llru->tagRingSize);
+	if (flags & LOWMEM_PACKED) {
+		// the new block is in before the victim goes
+		llru->packed = packed_init(lruSizeInBlks + 1);
+	} else {
+		// start small, the table grows with the working set
+		llru->table = hash_init(NUM_BUCKETS, flags | HASH_SAMPLE, hash_func);
+	}
+	if (llru->tagRing == NULL || (llru->packed == NULL && llru->table == NULL) ||
+			(llru->packed && llru->tagRingSize > PACKED_TAGS)) {
+		lowmemlru_destroy(llru);
+		return NULL;
+	}
+	memset(llru->tagRing, 0, sizeof(uint32)*llru->tagRingSize);
+	lowmemlru_set_sampling(llru, LOWMEM_SAMPLES, LOWMEM_SEED);
+	return llru;
+}
+
+void lowmemlru_set_sampling (struct lowmemlru *lru, uint32 samples, uint64 seed)
+{
+	lru->samples = samples ? samples : 1;
+	// xorshift never leaves zero
+	lru->seed = seed ? seed : LOWMEM_SEED;
+}
+
+/* the oldest tag joins the next one */
+static void fold_oldest_tag(struct lowmemlru *lru)
+{
+	TAG_COUNT(lru, lru->lowmemlruMaxTag + 1) += TAG_COUNT(lru, lru->lowmemlruMaxTag);
+	TAG_COUNT(lru, lru->lowmemlruMaxTag) = 0;
+	lru->lowmemlruMaxTag++;
+}
+
+static void decrement_tag_count(struct lowmemlru *lru, uint32 tag)
+{
+	if (tag < lru->lowmemlruMaxTag) {
+		tag = lru->lowmemlruMaxTag;
+	}
+	TAG_COUNT(lru, tag)--;
+	/*
+	 * see to it that there are lrupct blocks in the oldest group
+	 */
+	while (TAG_COUNT(lru, lru->lowmemlruMaxTag) < lru->lowmemblks &&
+			lru->lowmemlruMaxTag != lru->globalTag) {
+		fold_oldest_tag(lru);
+	}
+}
+
+/*
+ * evicts the oldest of lru->samples random blocks. every block in the
+ * oldest group is as old as any other, the first one found ends it.
+ * removed_key stays INVALID_KEY if there was nothing to sample.
+ */
+static void remove_blk(struct lowmemlru *lru, uint64 *removed_key)
+{
+	uint32 counter, nelements = hash_num_elements(lru->table);
+	uint64 key, victim = INVALID_KEY;
+	struct lowmemlru_ele *ele = NULL, *oldest = NULL;
+
+	*removed_key = INVALID_KEY;
+	if (nelements == 0) {
+		return;
+	}
+	for (counter = 0; counter < lru->samples; counter++) {
+		if (!hash_get_nth(lru->table, (prng_next(&lru->seed) >> 32) % nelements,
+				&key, (void **)&ele)) {
+			continue;
+		}
+		if (oldest == NULL || ele->blockTag < oldest->blockTag) {
+			oldest = ele;
+			victim = key;
+			if (oldest->blockTag <= lru->lowmemlruMaxTag) {
+				break;
+			}
+		}
+	}
+	if (oldest == NULL) {
+		return;
+	}
+	// the caller drops it from the hash table
+	*removed_key = victim;
+	decrement_tag_count(lru, oldest->blockTag);
+	free(oldest);
+}
+
+static void incement_lowmemlru_iocounter(struct lowmemlru *lru)
+{
+	lru->ioCounter++;
+	if (lru->ioCounter == lru->bumpupCounter) {
+		lru->ioCounter = 0;
+		// ring full, the two oldest tags become one
+		if (lru->globalTag - lru->lowmemlruMaxTag + 1 == lru->tagRingSize) {
+			fold_oldest_tag(lru);
+		}
+		lru->globalTag++;
+		TAG_COUNT(lru, lru->globalTag) = 0;
+	}
+	return ;
+}
+
+struct lowmemlru_ele* 
+lowmemlru_insert (struct lowmemlru *lru, uint64 key, uint64 *removed_key)
+{
+	struct lowmemlru_ele* ele = malloc(sizeof(struct lowmemlru_ele));
+	*removed_key = INVALID_KEY;
+	memset(ele, 0, sizeof(struct lowmemlru_ele));
+	ele->key = key;
+	ele->blockTag = lru->globalTag;
+	TAG_COUNT(lru, lru->globalTag)++;
+	incement_lowmemlru_iocounter(lru);
+	lru->blocksPresent++;
+	if (lru->blocksPresent > lru->cacheSize) {
+		remove_blk (lru, removed_key);
+		if (*removed_key != INVALID_KEY) {
+			lru->blocksPresent--;
+		}
+	}
+	return ele;
+}
+
+uint32 lowmemlru_bump(struct lowmemlru*lru, struct lowmemlru_ele* ele)
+{
+	if (ele->blockTag != lru->globalTag) {
+		decrement_tag_count(lru, ele->blockTag);
+		ele->blockTag = lru->globalTag;
+		TAG_COUNT(lru, lru->globalTag)++;
+	}
+	incement_lowmemlru_iocounter(lru);
+	return SUCCESS;
+}
+
+/*
+ * packed mode: the block and its tag are one packed_table slot, no
+ * element and no hash entry. only the low 16 bits of the tag are kept,
+ * they are taken relative to globalTag. live tags span less than the
+ * tag ring, a block left untouched for 64K tags looks young again
+ * until it ages back into the oldest group.
+ */
+static uint32 packed_tag(struct lowmemlru *lru, uint32 val)
+{
+	return lru->globalTag - ((lru->globalTag - val) & (PACKED_TAGS - 1));
+}
+
+static void packed_remove_blk(struct lowmemlru *lru)
+{
+	uint32 counter, slot, tag, victim = 0, oldest = 0;
+
+	for (counter = 0; counter < lru->samples; counter++) {
+		slot = packed_sample(lru->packed, &lru->seed);
+		tag = packed_tag(lru, PACKED_VAL(lru->packed->slots[slot]));
+		if (counter == 0 || tag < oldest) {
+			oldest = tag;
+			victim = slot;
+			if (oldest <= lru->lowmemlruMaxTag) {
+				break;
+			}
+		}
+	}
+	decrement_tag_count(lru, oldest);
+	packed_delete(lru->packed, victim);
+}
+
+static uint32 packed_access(struct lowmemlru *lru, uint64 key)
+{
+	uint32 slot = packed_lookup(lru->packed, key);
+	uint32 tag;
+
+	if (slot != PACKED_NONE) {
+		tag = packed_tag(lru, PACKED_VAL(lru->packed->slots[slot]));
+		if (tag != lru->globalTag) {
+			decrement_tag_count(lru, tag);
+			packed_set_val(lru->packed, slot, lru->globalTag);
+			TAG_COUNT(lru, lru->globalTag)++;
+		}
+		incement_lowmemlru_iocounter(lru);
+		return SUCCESS;
+	}
+	packed_insert(lru->packed, key, lru->globalTag & (PACKED_TAGS - 1));
+	TAG_COUNT(lru, lru->globalTag)++;
+	incement_lowmemlru_iocounter(lru);
+	lru->blocksPresent++;
+	if (lru->blocksPresent > lru->cacheSize) {
+		packed_remove_blk(lru);
+		lru->blocksPresent--;
+	}
+	return FAILURE;
+}
+
+uint32 lowmemlru_access (struct lowmemlru *lru, uint64 key)
+{
+	struct lowmemlru_ele *ele;
+	uint64 removed_key;
+
+	if (lru->packed) {
+		return packed_access(lru, key);
+	}
+	if (hash_lookup(lru->table, key, (void **)&ele)) {
+		lowmemlru_bump(lru, ele);
+		return SUCCESS;
+	}
+	hash_insert(lru->table, key, lowmemlru_insert(lru, key, &removed_key));
+	if (removed_key != INVALID_KEY) {
+		hash_delete(lru->table, removed_key, NULL);
+	}
+	return FAILURE;
+}
+
+uint32 lowmemlru_num_elements (struct lowmemlru *lru)
+{
+	return lru->packed ? lru->packed->nelements : hash_num_elements(lru->table);
+}
+
+uint64 lowmemlru_memory (struct lowmemlru *lru)
+{
+	uint64 bytes = sizeof(*lru) + sizeof(uint32)*lru->tagRingSize;
+
+	if (lru->packed) {
+		return bytes + packed_memory(lru->packed);
+	}
+	// a malloc'd element costs its glibc chunk, the size plus an 8 byte header rounded up to 16
+	return bytes + hash_memory(lru->table) +
+		(uint64)hash_num_elements(lru->table)*((sizeof(struct lowmemlru_ele) + 8 + 15) & ~15);
+}
+
+void lowmemlru_destroy (struct lowmemlru *lru)
+{
+	struct lowmemlru_ele *ele;
+	uint64 key;
+	uint32 i;
+
+	if (lru == NULL) {
+		return;
+	}
+	if (lru->table) {
+		for (i = 0; i < hash_num_elements(lru->table); i++) {
+			if (hash_get_nth(lru->table, i, &key, (void **)&ele)) {
+				free(ele);
+			}
+		}
+		hash_destroy(lru->table);
+	}
+	packed_destroy(lru->packed);
+	free(lru->tagRing);
+	free(lru);
+}
@@ -5,20 +5,201 @@
 #include "types.h"
 #include "lru.h"
 
+#define IS_INTRUSIVE(lru)	((lru)->flags & LRU_INTRUSIVE)
+#define SLOT(lru, ele)	((uint32)((struct lru_slot *)(ele) - (lru)->slots))
+#define ELE(lru, i)	((struct lru_ele *)&(lru)->slots[i])
+
+/* ----------------------- intrusive ----------------------- */
+
+static uint32 ilru_bucket(struct lru *lru, uint64 key)
+{
+	return (key*0x9E3779B97F4A7C15ULL) >> (64 - lru->bucket_bits);
+}
+
+static uint32 ilru_init(struct lru *lru)
+{
+	uint64 nbuckets;
+
+	if (lru->max_elements == 0 || lru->max_elements == LRU_NIL) {
+		return FAILURE;
+	}
+	lru->bucket_bits = 1;
+	while ((1ULL << lru->bucket_bits) < lru->max_elements) {
+		lru->bucket_bits++;
+	}
+	nbuckets = 1ULL << lru->bucket_bits;
+	lru->slot_cap = lru->max_elements;
+	lru->slots = malloc(sizeof(struct lru_slot)*(uint64)lru->slot_cap);
+	lru->buckets = malloc(sizeof(uint32)*nbuckets);
+	if (lru->slots == NULL || lru->buckets == NULL) {
+		free(lru->slots);
+		free(lru->buckets);
+		return FAILURE;
+	}
+	memset(lru->buckets, 0xFF, sizeof(uint32)*nbuckets);
+	lru->ihead = lru->itail = lru->free = LRU_NIL;
+	return SUCCESS;
+}
+
+static void ilru_unlink(struct lru *lru, uint32 i)
+{
+	struct lru_slot *slot = &lru->slots[i];
+
+	if (slot->prev != LRU_NIL) {
+		lru->slots[slot->prev].next = slot->next;
+	} else {
+		lru->itail = slot->next;
+	}
+	if (slot->next != LRU_NIL) {
+		lru->slots[slot->next].prev = slot->prev;
+	} else {
+		lru->ihead = slot->prev;
+	}
+}
+
+/* links slot i one step more recent than pos, LRU_NIL means the tail */
+static void ilru_link_after(struct lru *lru, uint32 pos, uint32 i)
+{
+	struct lru_slot *slot = &lru->slots[i];
+
+	slot->prev = pos;
+	slot->next = pos == LRU_NIL ? lru->itail : lru->slots[pos].next;
+	if (slot->next != LRU_NIL) {
+		lru->slots[slot->next].prev = i;
+	} else {
+		lru->ihead = i;
+	}
+	if (pos != LRU_NIL) {
+		lru->slots[pos].next = i;
+	} else {
+		lru->itail = i;
+	}
+}
+
+/* most recent end, stamped with the caller's clock if it has one */
+static void ilru_link_head(struct lru *lru, uint32 i)
+{
+	if (lru->clock) {
+		lru->slots[i].stamp = __atomic_load_n(lru->clock, __ATOMIC_RELAXED);
+	}
+	ilru_link_after(lru, lru->ihead, i);
+}
+
+static void ilru_hash_remove(struct lru *lru, uint32 i)
+{
+	uint32 *p = &lru->buckets[ilru_bucket(lru, lru->slots[i].key)];
+
+	while (*p != i) {
+		p = &lru->slots[*p].hnext;
+	}
+	*p = lru->slots[i].hnext;
+}
+
+static uint32 ilru_get_slot(struct lru *lru, uint64 key)
+{
+	uint32 i, b;
+
+	if (lru->free != LRU_NIL) {
+		i = lru->free;
+		lru->free = lru->slots[i].next;
+	} else if (lru->nused < lru->slot_cap) {
+		i = lru->nused++;
+	} else {
+		return LRU_NIL;
+	}
+	b = ilru_bucket(lru, key);
+	lru->slots[i].key = key;
+	lru->slots[i].hnext = lru->buckets[b];
+	lru->buckets[b] = i;
+	lru->nelements++;
+	return i;
+}
+
+static void ilru_put_slot(struct lru *lru, uint32 i)
+{
+	ilru_hash_remove(lru, i);
+	lru->slots[i].next = lru->free;
+	lru->free = i;
+	lru->nelements--;
+}
+
+static struct lru_ele* ilru_insert(struct lru *lru, uint64 key, uint64 *removed_key)
+{
+	uint32 i;
+
+	if (lru->nelements == lru->max_elements) {
+		// reuse the tail slot for the new block
+		i = lru->itail;
+		*removed_key = lru->slots[i].key;
+		ilru_unlink(lru, i);
+		ilru_put_slot(lru, i);
+	}
+	i = ilru_get_slot(lru, key);
+	ilru_link_head(lru, i);
+	return ELE(lru, i);
+}
+
+/* ----------------------- api ----------------------- */
 
 struct lru * lru_init (uint32 max_elements)
+{
+	return lru_init_flags(max_elements, 0);
+}
+
+struct lru * lru_init_flags (uint32 max_elements, uint32 flags)
 {
 	struct lru * lru = malloc(sizeof(*lru));
+	if (lru == NULL) {
+		return NULL;
+	}
 	memset(lru, 0, sizeof(*lru));
-	lru->max_elements = max_elements;
+	lru->max_elements = lru->low_mark = max_elements;
+	lru->flags = flags;
+	if (IS_INTRUSIVE(lru)) {
+		if (!ilru_init(lru)) {
+			free(lru);
+			return NULL;
+		}
+		return lru;
+	}
+	lru->pool = pool_init(sizeof(struct lru_ele), 0);
+	if (lru->pool == NULL) {
+		free(lru);
+		return NULL;
+	}
 	return lru;
 }
 
+/*
+ * intrusive lrus only, returns the handle of key or NULL when it is not
+ * cached.
+ */
+struct lru_ele* lru_lookup (struct lru *lru, uint64 key)
+{
+	uint32 i;
+
+	if (!IS_INTRUSIVE(lru)) {
+		return NULL;
+	}
+	i = lru->buckets[ilru_bucket(lru, key)];
+	while (i != LRU_NIL && lru->slots[i].key != key) {
+		i = lru->slots[i].hnext;
+	}
+	return i == LRU_NIL ? NULL : ELE(lru, i);
+}
+
 struct lru_ele* lru_insert (struct lru *lru, uint64 key, uint64 *removed_key)
 {
 	struct lru_ele * removed_ele = NULL;
-	struct lru_ele * ele = malloc(sizeof(*ele));
+	struct lru_ele * ele;
 	*removed_key = INVALID_KEY;
+	if (IS_INTRUSIVE(lru)) {
+		return ilru_insert(lru, key, removed_key);
+	}
+	ele = pool_alloc(lru->pool);
+	if (ele == NULL) {
+		return NULL;
+	}
 	memset(ele, 0, sizeof(*ele));
 	ele->key = key;
 	ele->prev = lru->head;
@@ -39,13 +220,20 @@ struct lru_ele* lru_insert (struct lru *lru, uint64 key, uint64 *removed_key)
 	}
 	if (removed_ele) {
 		*removed_key = removed_ele->key;
-		free(removed_ele);
+		pool_free(lru->pool, removed_ele);
 	}
 	return ele;
 }
 
 uint32 lru_bump (struct lru * lru, struct lru_ele * ele) 
 {
+	if (IS_INTRUSIVE(lru)) {
+		if (SLOT(lru, ele) != lru->ihead) {
+			ilru_unlink(lru, SLOT(lru, ele));
+			ilru_link_head(lru, SLOT(lru, ele));
+		}
+		return SUCCESS;
+	}
 	if (ele == lru->head)	return SUCCESS;
 	
 	if (ele == lru->tail) {
@@ -63,5 +251,215 @@ uint32 lru_bump (struct lru * lru, struct lru_ele * ele)
 	lru->head = ele;
 	return SUCCESS;
 }
-	
-		
+
+/*
+ * inserts key just above pos, i.e. one step more recent than pos.
+ * never evicts.
+ */
+struct lru_ele* lru_insert_after (struct lru *lru, struct lru_ele *pos, uint64 key)
+{
+	struct lru_ele * ele;
+	uint32 i;
+
+	if (IS_INTRUSIVE(lru)) {
+		i = ilru_get_slot(lru, key);
+		if (i == LRU_NIL) {
+			return NULL;
+		}
+		ilru_link_after(lru, SLOT(lru, pos), i);
+		return ELE(lru, i);
+	}
+	ele = pool_alloc(lru->pool);
+	if (ele == NULL) {
+		return NULL;
+	}
+	ele->key = key;
+	ele->prev = pos;
+	ele->next = pos->next;
+	if (pos->next) {
+		pos->next->prev = ele;
+	} else {
+		lru->head = ele;
+	}
+	pos->next = ele;
+	lru->nelements++;
+	return ele;
+}
+
+uint32 lru_remove (struct lru *lru, struct lru_ele *ele)
+{
+	if (IS_INTRUSIVE(lru)) {
+		ilru_unlink(lru, SLOT(lru, ele));
+		ilru_put_slot(lru, SLOT(lru, ele));
+		return SUCCESS;
+	}
+	if (ele->prev) {
+		ele->prev->next = ele->next;
+	} else {
+		lru->tail = ele->next;
+	}
+	if (ele->next) {
+		ele->next->prev = ele->prev;
+	} else {
+		lru->head = ele->prev;
+	}
+	lru->nelements--;
+	pool_free(lru->pool, ele);
+	return SUCCESS;
+}
+
+/*
+ * evicts up to n elements from the tail in one go, their keys go to
+ * removed unless it is NULL. returns the number evicted.
+ */
+uint32 lru_evict (struct lru *lru, uint32 n, uint64 *removed)
+{
+	struct lru_ele * ele;
+	uint32 i;
+
+	if (n > lru->nelements) {
+		n = lru->nelements;
+	}
+	if (IS_INTRUSIVE(lru)) {
+		for (i = 0; i < n; i++) {
+			if (removed)	removed[i] = lru->slots[lru->itail].key;
+			lru_remove(lru, ELE(lru, lru->itail));
+		}
+		return n;
+	}
+	for (i = 0; i < n; i++) {
+		ele = lru->tail;
+		if (removed)	removed[i] = ele->key;
+		lru->tail = ele->next;
+		pool_free(lru->pool, ele);
+	}
+	if (lru->tail) {
+		lru->tail->prev = NULL;
+	} else {
+		lru->head = NULL;
+	}
+	lru->nelements -= n;
+	return n;
+}
+
+uint32 lru_insert_batch (struct lru *lru, uint64 *keys, uint32 n, struct lru_ele **eles, uint64 *removed)
+{
+	struct lru_ele * ele;
+	uint32 i, nremoved = 0, skip = 0;
+	uint64 over;
+
+	// make room for the whole batch at once, down to the low watermark
+	over = (uint64)lru->nelements + n;
+	if (over > lru->max_elements) {
+		over -= lru->low_mark;
+		if (over > lru->nelements) {
+			// more keys than fit, the first ones would be evicted right away
+			skip = over - lru->nelements;
+			if (skip > n) {
+				skip = n;
+			}
+		}
+		nremoved = lru_evict(lru, over - skip, removed);
+	}
+	for (i = 0; i < skip; i++) {
+		eles[i] = NULL;
+		removed[nremoved++] = keys[i];
+	}
+	for (; i < n; i++) {
+		if (IS_INTRUSIVE(lru)) {
+			eles[i] = ELE(lru, ilru_get_slot(lru, keys[i]));
+			ilru_link_head(lru, SLOT(lru, eles[i]));
+			continue;
+		}
+		ele = pool_alloc(lru->pool);
+		eles[i] = ele;
+		if (ele == NULL) {
+			continue;
+		}
+		ele->key = keys[i];
+		ele->next = NULL;
+		ele->prev = lru->head;
+		if (lru->head) {
+			lru->head->next = ele;
+		} else {
+			lru->tail = ele;
+		}
+		lru->head = ele;
+		lru->nelements++;
+	}
+	return nremoved;
+}
+
+/*
+ * lets lru_insert_batch free max_elements - low_mark extra elements when
+ * it runs out of room, instead of evicting exactly what it needs.
+ */
+void lru_set_low_watermark (struct lru *lru, uint32 low_mark)
+{
+	lru->low_mark = low_mark < lru->max_elements ? low_mark : lru->max_elements;
+}
+
+/*
+ * changes the capacity, evicting from the tail when it shrinks. growing
+ * an intrusive lru reallocates its slots, handles given out before are
+ * no longer valid after that.
+ */
+uint32 lru_resize (struct lru *lru, uint32 max_elements, uint64 *removed)
+{
+	struct lru_slot * slots;
+	uint32 gap;
+
+	if (max_elements == 0) {
+		return FAILURE;
+	}
+	if (IS_INTRUSIVE(lru) && max_elements > lru->slot_cap) {
+		slots = realloc(lru->slots, sizeof(struct lru_slot)*(uint64)max_elements);
+		if (slots == NULL) {
+			return FAILURE;
+		}
+		lru->slots = slots;
+		lru->slot_cap = max_elements;
+	}
+	if (lru->nelements > max_elements) {
+		lru_evict(lru, lru->nelements - max_elements, removed);
+	}
+	// keep the same bulk eviction gap
+	gap = lru->max_elements - lru->low_mark;
+	lru->low_mark = gap < max_elements ? max_elements - gap : 0;
+	lru->max_elements = max_elements;
+	return SUCCESS;
+}
+
+/* stamp of the least recently used element, 0 if empty or unstamped */
+uint32 lru_tail_stamp (struct lru *lru)
+{
+	if (!IS_INTRUSIVE(lru) || lru->itail == LRU_NIL) {
+		return 0;
+	}
+	return lru->slots[lru->itail].stamp;
+}
+
+/* bytes held by the lru, not counting a separate hash table */
+uint64 lru_memory (struct lru *lru)
+{
+	uint64 bytes = sizeof(*lru);
+
+	if (IS_INTRUSIVE(lru)) {
+		bytes += (uint64)sizeof(struct lru_slot)*lru->slot_cap;
+		bytes += (uint64)sizeof(uint32) << lru->bucket_bits;
+	} else {
+		bytes += pool_bytes(lru->pool);
+	}
+	return bytes;
+}
+
+void lru_destroy (struct lru *lru)
+{
+	if (lru == NULL) {
+		return;
+	}
+	pool_destroy(lru->pool);
+	free(lru->slots);
+	free(lru->buckets);
+	free(lru);
+}
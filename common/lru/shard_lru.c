@@ -0,0 +1,168 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+#include "shard_lru.h"
+
+struct shard_lru *shard_lru_init(uint32 nshards, uint32 max_elements)
+{
+	struct shard_lru * sl;
+	uint32 i, per_shard;
+
+	if (nshards == 0 || max_elements < nshards) {
+		return NULL;
+	}
+	sl = malloc(sizeof(*sl));
+	if (sl == NULL) {
+		return NULL;
+	}
+	memset(sl, 0, sizeof(*sl));
+	sl->nshards = nshards;
+	// the clock starts at 1 so that 0 means never stamped
+	sl->clock = 1;
+	if (posix_memalign((void **)&sl->shards, SHARD_LRU_CACHELINE,
+				sizeof(struct lru_shard)*nshards)) {
+		free(sl);
+		return NULL;
+	}
+	memset(sl->shards, 0, sizeof(struct lru_shard)*nshards);
+	for (i = 0; i < nshards; i++) {
+		pthread_mutex_init(&sl->shards[i].lock, NULL);
+		// the first shards take the remainder
+		per_shard = max_elements/nshards + (i < max_elements % nshards);
+		sl->shards[i].lru = lru_init_flags(per_shard, LRU_INTRUSIVE);
+		if (sl->shards[i].lru == NULL) {
+			shard_lru_destroy(sl);
+			return NULL;
+		}
+		sl->shards[i].lru->clock = &sl->clock;
+	}
+	return sl;
+}
+
+static struct lru_shard * get_shard(struct shard_lru *sl, uint64 key)
+{
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdULL;
+	key ^= key >> 33;
+	return &sl->shards[(key >> 32) % sl->nshards];
+}
+
+uint32 shard_lru_access(struct shard_lru *sl, uint64 key, uint64 *removed_key)
+{
+	struct lru_shard * shard = get_shard(sl, key);
+	struct lru_ele * ele;
+	uint32 ret = SUCCESS;
+
+	*removed_key = INVALID_KEY;
+	pthread_mutex_lock(&shard->lock);
+	if (++shard->ticks == SHARD_LRU_TICK) {
+		shard->ticks = 0;
+		__atomic_fetch_add(&sl->clock, 1, __ATOMIC_RELAXED);
+	}
+	ele = lru_lookup(shard->lru, key);
+	if (ele) {
+		shard->hits++;
+		lru_bump(shard->lru, ele);
+	} else {
+		shard->misses++;
+		lru_insert(shard->lru, key, removed_key);
+		ret = FAILURE;
+	}
+	pthread_mutex_unlock(&shard->lock);
+	return ret;
+}
+
+/*
+ * moves step blocks of capacity from the shard whose lru tail is the
+ * oldest to the one whose tail is the youngest. returns FAILURE when the
+ * tails are within a clock tick or no shard has room to give.
+ */
+uint32 shard_lru_rebalance(struct shard_lru *sl, uint32 step)
+{
+	struct lru_shard * donor = NULL, * taker = NULL;
+	uint32 i, stamp, oldest = 0xFFFFFFFF, youngest = 0;
+	uint32 max;
+
+	for (i = 0; i < sl->nshards; i++) {
+		pthread_mutex_lock(&sl->shards[i].lock);
+		stamp = lru_tail_stamp(sl->shards[i].lru);
+		max = sl->shards[i].lru->max_elements;
+		// only full shards evict, the others have no tail age to compare
+		if (stamp && sl->shards[i].lru->nelements == max) {
+			if (stamp < oldest && max > step) {
+				oldest = stamp;
+				donor = &sl->shards[i];
+			}
+			if (stamp > youngest) {
+				youngest = stamp;
+				taker = &sl->shards[i];
+			}
+		}
+		pthread_mutex_unlock(&sl->shards[i].lock);
+	}
+	// a tick apart is just noise between evenly loaded shards
+	if (!donor || !taker || donor == taker || oldest + 1 >= youngest) {
+		return FAILURE;
+	}
+	// one lock at a time, capacity is briefly short by step in between
+	pthread_mutex_lock(&donor->lock);
+	max = donor->lru->max_elements;
+	if (max <= step || !lru_resize(donor->lru, max - step, NULL)) {
+		pthread_mutex_unlock(&donor->lock);
+		return FAILURE;
+	}
+	pthread_mutex_unlock(&donor->lock);
+	pthread_mutex_lock(&taker->lock);
+	if (!lru_resize(taker->lru, taker->lru->max_elements + step, NULL)) {
+		pthread_mutex_unlock(&taker->lock);
+		// give it back rather than lose the capacity
+		pthread_mutex_lock(&donor->lock);
+		lru_resize(donor->lru, donor->lru->max_elements + step, NULL);
+		pthread_mutex_unlock(&donor->lock);
+		return FAILURE;
+	}
+	pthread_mutex_unlock(&taker->lock);
+	return SUCCESS;
+}
+
+uint64 shard_lru_num_elements(struct shard_lru *sl)
+{
+	uint64 total = 0;
+	uint32 i;
+
+	for (i = 0; i < sl->nshards; i++) {
+		pthread_mutex_lock(&sl->shards[i].lock);
+		total += sl->shards[i].lru->nelements;
+		pthread_mutex_unlock(&sl->shards[i].lock);
+	}
+	return total;
+}
+
+void shard_lru_stats(struct shard_lru *sl, uint64 *hits, uint64 *misses)
+{
+	uint32 i;
+
+	*hits = *misses = 0;
+	for (i = 0; i < sl->nshards; i++) {
+		pthread_mutex_lock(&sl->shards[i].lock);
+		*hits += sl->shards[i].hits;
+		*misses += sl->shards[i].misses;
+		pthread_mutex_unlock(&sl->shards[i].lock);
+	}
+}
+
+void shard_lru_destroy(struct shard_lru *sl)
+{
+	uint32 i;
+
+	if (sl == NULL) {
+		return;
+	}
+	for (i = 0; i < sl->nshards; i++) {
+		lru_destroy(sl->shards[i].lru);
+		pthread_mutex_destroy(&sl->shards[i].lock);
+	}
+	free(sl->shards);
+	free(sl);
+}
@@ -0,0 +1,316 @@
+
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+#include "hash_funcs.h"
+#include "mrc.h"
+#include "prng.h"
+
+#define NIL	0xFFFFFFFF
+#define SIZE(mrc, n)	((n) == NIL ? 0 : (mrc)->nodes[n].size)
+
+static void update(struct mrc *mrc, uint32 n)
+{
+	mrc->nodes[n].size = 1 + SIZE(mrc, mrc->nodes[n].left) + SIZE(mrc, mrc->nodes[n].right);
+}
+
+/* every time in a is older than every time in b */
+static uint32 merge(struct mrc *mrc, uint32 a, uint32 b)
+{
+	if (a == NIL)	return b;
+	if (b == NIL)	return a;
+	if (mrc->nodes[a].prio > mrc->nodes[b].prio) {
+		mrc->nodes[a].right = merge(mrc, mrc->nodes[a].right, b);
+		update(mrc, a);
+		return a;
+	}
+	mrc->nodes[b].left = merge(mrc, a, mrc->nodes[b].left);
+	update(mrc, b);
+	return b;
+}
+
+static uint32 unlink_time(struct mrc *mrc, uint32 n, uint64 time)
+{
+	struct mrc_node * node = &mrc->nodes[n];
+
+	if (node->time == time) {
+		return merge(mrc, node->left, node->right);
+	}
+	if (time < node->time) {
+		node->left = unlink_time(mrc, node->left, time);
+	} else {
+		node->right = unlink_time(mrc, node->right, time);
+	}
+	node->size--;
+	return n;
+}
+
+/* blocks accessed after time */
+static uint64 count_newer(struct mrc *mrc, uint64 time)
+{
+	uint32 n = mrc->root;
+	uint64 count = 0;
+
+	while (n != NIL) {
+		if (mrc->nodes[n].time > time) {
+			count += SIZE(mrc, mrc->nodes[n].right) + 1;
+			n = mrc->nodes[n].left;
+		} else if (mrc->nodes[n].time < time) {
+			n = mrc->nodes[n].right;
+		} else {
+			count += SIZE(mrc, mrc->nodes[n].right);
+			break;
+		}
+	}
+	return count;
+}
+
+static uint32 alloc_node(struct mrc *mrc)
+{
+	struct mrc_node * nodes;
+	uint32 n;
+
+	if (mrc->free != NIL) {
+		n = mrc->free;
+		mrc->free = mrc->nodes[n].left;
+		return n;
+	}
+	if (mrc->nused == mrc->nnodes) {
+		n = mrc->nnodes ? 2*mrc->nnodes : 1024;
+		if (mrc->nnodes >= NIL/2) {
+			return NIL;
+		}
+		nodes = realloc(mrc->nodes, sizeof(struct mrc_node)*(uint64)n);
+		if (nodes == NULL) {
+			return NIL;
+		}
+		mrc->nodes = nodes;
+		mrc->nnodes = n;
+	}
+	return mrc->nused++;
+}
+
+static uint32 grow_hist(struct mrc *mrc, uint64 dist)
+{
+	uint64 size = mrc->hist_size ? 2*mrc->hist_size : 1024;
+	double * hist;
+
+	while (size <= dist) {
+		size <<= 1;
+	}
+	hist = realloc(mrc->hist, sizeof(double)*size);
+	if (hist == NULL) {
+		return FAILURE;
+	}
+	memset(hist + mrc->hist_size, 0, sizeof(double)*(size - mrc->hist_size));
+	mrc->hist = hist;
+	mrc->hist_size = size;
+	return SUCCESS;
+}
+
+/* independent of the hash table's own hash */
+static uint32 spatial_hash(uint64 key)
+{
+	key ^= key >> 31;
+	key *= 0x7fb5d329728ea185ULL;
+	key ^= key >> 27;
+	key *= 0x81dadef4bc2dd44dULL;
+	key ^= key >> 33;
+	return key >> (64 - MRC_HASH_BITS);
+}
+
+static void heap_push(struct mrc *mrc, uint64 key, uint32 hash)
+{
+	struct mrc_sample tmp;
+	uint32 i = mrc->nheap++, p;
+
+	mrc->heap[i].key = key;
+	mrc->heap[i].hash = hash;
+	while (i && mrc->heap[p = (i - 1)/2].hash < mrc->heap[i].hash) {
+		tmp = mrc->heap[p];
+		mrc->heap[p] = mrc->heap[i];
+		mrc->heap[i] = tmp;
+		i = p;
+	}
+}
+
+static uint64 heap_pop(struct mrc *mrc)
+{
+	struct mrc_sample tmp;
+	uint64 key = mrc->heap[0].key;
+	uint32 i = 0, c;
+
+	mrc->heap[0] = mrc->heap[--mrc->nheap];
+	while ((c = 2*i + 1) < mrc->nheap) {
+		if (c + 1 < mrc->nheap && mrc->heap[c + 1].hash > mrc->heap[c].hash) {
+			c++;
+		}
+		if (mrc->heap[i].hash >= mrc->heap[c].hash) {
+			break;
+		}
+		tmp = mrc->heap[c];
+		mrc->heap[c] = mrc->heap[i];
+		mrc->heap[i] = tmp;
+		i = c;
+	}
+	return key;
+}
+
+/*
+ * stops tracking the blocks with the highest hash, which becomes the
+ * threshold, and rescales everything counted so far to the new rate.
+ */
+static void lower_threshold(struct mrc *mrc)
+{
+	uint32 top = mrc->heap[0].hash, n;
+	void * data;
+
+	// a threshold of 0 would track nothing
+	if (top == 0) {
+		return;
+	}
+	while (mrc->nheap && mrc->heap[0].hash == top) {
+		hash_delete(mrc->last, heap_pop(mrc), &data);
+		n = (uint32)(uint64)data;
+		mrc->root = unlink_time(mrc, mrc->root, mrc->nodes[n].time);
+		mrc->nodes[n].left = mrc->free;
+		mrc->free = n;
+	}
+	mrc->scale = mrc->scale*top/mrc->threshold;
+	mrc->threshold = top;
+}
+
+struct mrc * mrc_init (void)
+{
+	struct mrc * mrc = malloc(sizeof(*mrc));
+
+	if (mrc == NULL) {
+		return NULL;
+	}
+	memset(mrc, 0, sizeof(*mrc));
+	mrc->root = mrc->free = NIL;
+	mrc->seed = 0x9e3779b97f4a7c15ULL;
+	mrc->scale = 1.0;
+	mrc->threshold = MRC_HASH_SPACE;
+	mrc->last = hash_init(1024, HASH_OPEN, hash_murmur);
+	if (mrc->last == NULL || !grow_hist(mrc, 0)) {
+		mrc_destroy(mrc);
+		return NULL;
+	}
+	return mrc;
+}
+
+uint32 mrc_set_sampling (struct mrc *mrc, double rate, uint32 max_samples)
+{
+	// only before the first access
+	if (mrc->accesses || rate <= 0 || rate > 1) {
+		return FAILURE;
+	}
+	mrc->threshold = rate*MRC_HASH_SPACE;
+	if (mrc->threshold == 0) {
+		mrc->threshold = 1;
+	}
+	mrc->max_samples = max_samples;
+	if (max_samples) {
+		free(mrc->heap);
+		// one over while the newest block is in before lower_threshold
+		mrc->heap = malloc(sizeof(struct mrc_sample)*(max_samples + 1ULL));
+		if (mrc->heap == NULL) {
+			mrc->max_samples = 0;
+			return FAILURE;
+		}
+	}
+	return SUCCESS;
+}
+
+uint64 mrc_access (struct mrc *mrc, uint64 key)
+{
+	struct mrc_node * node;
+	uint64 dist = 0;
+	uint32 hash = MRC_HASH_SPACE - 1;
+	uint32 isnew = 0;
+	void * data;
+	uint32 n;
+
+	mrc->accesses++;
+	// the heap orders blocks by hash even while all of them are tracked
+	if (mrc->threshold < MRC_HASH_SPACE || mrc->max_samples) {
+		hash = spatial_hash(key);
+		if (hash >= mrc->threshold) {
+			return 0;
+		}
+	}
+	if (hash_lookup(mrc->last, key, &data)) {
+		n = (uint32)(uint64)data;
+		dist = count_newer(mrc, mrc->nodes[n].time) + 1;
+		dist = dist*MRC_HASH_SPACE/mrc->threshold;
+		if (dist >= mrc->hist_size && !grow_hist(mrc, dist)) {
+			return 0;
+		}
+		mrc->hist[dist] += 1/mrc->scale;
+		mrc->root = unlink_time(mrc, mrc->root, mrc->nodes[n].time);
+	} else {
+		n = alloc_node(mrc);
+		if (n == NIL) {
+			return 0;
+		}
+		hash_insert(mrc->last, key, (void *)(uint64)n);
+		mrc->cold += 1/mrc->scale;
+		isnew = 1;
+	}
+	mrc->sampled += 1/mrc->scale;
+	// now the newest, it goes in at the right end
+	node = &mrc->nodes[n];
+	node->time = mrc->now++;
+	node->left = node->right = NIL;
+	node->size = 1;
+	node->prio = prng_next(&mrc->seed) >> 32;
+	mrc->root = merge(mrc, mrc->root, n);
+	// the heap is full only if lower_threshold could not go lower
+	if (isnew && mrc->max_samples && mrc->nheap <= mrc->max_samples) {
+		heap_push(mrc, key, hash);
+		if (mrc->nheap > mrc->max_samples) {
+			lower_threshold(mrc);
+		}
+	}
+	return dist;
+}
+
+/* the tracked accesses' hit ratio, applied to all of them */
+void mrc_hits (struct mrc *mrc, uint64 *sizes, uint32 n, uint64 *hits)
+{
+	uint64 d = 1;
+	double sum = 0;
+	uint32 i;
+
+	for (i = 0; i < n; i++) {
+		while (d <= sizes[i] && d < mrc->hist_size) {
+			sum += mrc->hist[d++];
+		}
+		hits[i] = mrc->sampled ? (uint64)(sum/mrc->sampled*mrc->accesses + 0.5) : 0;
+	}
+}
+
+uint64 mrc_blocks (struct mrc *mrc)
+{
+	return (uint64)(mrc->cold*mrc->scale*MRC_HASH_SPACE/mrc->threshold + 0.5);
+}
+
+uint64 mrc_memory (struct mrc *mrc)
+{
+	return sizeof(*mrc) + hash_memory(mrc->last) +
+		(uint64)sizeof(struct mrc_node)*mrc->nnodes + sizeof(double)*mrc->hist_size +
+		(mrc->max_samples ? sizeof(struct mrc_sample)*(mrc->max_samples + 1ULL) : 0);
+}
+
+void mrc_destroy (struct mrc *mrc)
+{
+	if (mrc == NULL) {
+		return;
+	}
+	hash_destroy(mrc->last);
+	free(mrc->nodes);
+	free(mrc->hist);
+	free(mrc->heap);
+	free(mrc);
+}
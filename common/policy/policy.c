@@ -0,0 +1,301 @@
+#include <stdio.h>
+#include <string.h>
+#include "types.h"
+#include "policy.h"
+#include "lru.h"
+#include "clock.h"
+#include "arc.h"
+#include "twoq.h"
+#include "lirs.h"
+#include "sieve.h"
+#include "s3fifo.h"
+
+/* ----------------------- lru ----------------------- */
+
+static void * p_lru_init(uint32 max_elements)
+{
+	return lru_init(max_elements);
+}
+
+static void * p_lru_insert(void *cache, uint64 key, uint64 *removed_key)
+{
+	return lru_insert(cache, key, removed_key);
+}
+
+static uint32 p_lru_bump(void *cache, void *ele)
+{
+	return lru_bump(cache, ele);
+}
+
+static uint32 p_lru_num_elements(void *cache)
+{
+	return ((struct lru *)cache)->nelements;
+}
+
+static uint64 p_lru_memory(void *cache)
+{
+	return lru_memory(cache);
+}
+
+static void p_lru_destroy(void *cache)
+{
+	lru_destroy(cache);
+}
+
+/* ----------------------- clock ----------------------- */
+
+static void * p_clock_init(uint32 max_elements)
+{
+	return clock_init(max_elements);
+}
+
+static void * p_clock_insert(void *cache, uint64 key, uint64 *removed_key)
+{
+	return clock_insert(cache, key, removed_key);
+}
+
+static uint32 p_clock_bump(void *cache, void *ele)
+{
+	return clock_bump(cache, ele);
+}
+
+static uint32 p_clock_num_elements(void *cache)
+{
+	return ((struct clock *)cache)->nelements;
+}
+
+static uint64 p_clock_memory(void *cache)
+{
+	return clock_memory(cache);
+}
+
+static void p_clock_destroy(void *cache)
+{
+	clock_destroy(cache);
+}
+
+/* ----------------------- clock-pro ----------------------- */
+
+static void * p_clockpro_init(uint32 max_elements)
+{
+	return clockpro_init(max_elements);
+}
+
+static void * p_clockpro_insert(void *cache, uint64 key, uint64 *removed_key)
+{
+	return clockpro_insert(cache, key, removed_key);
+}
+
+static uint32 p_clockpro_bump(void *cache, void *ele)
+{
+	return clockpro_bump(cache, ele);
+}
+
+static uint32 p_clockpro_num_elements(void *cache)
+{
+	return clockpro_num_elements(cache);
+}
+
+static uint64 p_clockpro_memory(void *cache)
+{
+	return clockpro_memory(cache);
+}
+
+static void p_clockpro_destroy(void *cache)
+{
+	clockpro_destroy(cache);
+}
+
+/* ----------------------- arc ----------------------- */
+
+static void * p_arc_init(uint32 max_elements)
+{
+	return arc_init(max_elements);
+}
+
+static void * p_arc_insert(void *cache, uint64 key, uint64 *removed_key)
+{
+	return arc_insert(cache, key, removed_key);
+}
+
+static uint32 p_arc_bump(void *cache, void *ele)
+{
+	return arc_bump(cache, ele);
+}
+
+static uint32 p_arc_num_elements(void *cache)
+{
+	return arc_num_elements(cache);
+}
+
+static uint64 p_arc_memory(void *cache)
+{
+	return arc_memory(cache);
+}
+
+static void p_arc_destroy(void *cache)
+{
+	arc_destroy(cache);
+}
+
+/* ----------------------- 2q ----------------------- */
+
+static void * p_twoq_init(uint32 max_elements)
+{
+	return twoq_init(max_elements);
+}
+
+static void * p_twoq_insert(void *cache, uint64 key, uint64 *removed_key)
+{
+	return twoq_insert(cache, key, removed_key);
+}
+
+static uint32 p_twoq_bump(void *cache, void *ele)
+{
+	return twoq_bump(cache, ele);
+}
+
+static uint32 p_twoq_num_elements(void *cache)
+{
+	return twoq_num_elements(cache);
+}
+
+static uint64 p_twoq_memory(void *cache)
+{
+	return twoq_memory(cache);
+}
+
+static void p_twoq_destroy(void *cache)
+{
+	twoq_destroy(cache);
+}
+
+/* ----------------------- lirs ----------------------- */
+
+static void * p_lirs_init(uint32 max_elements)
+{
+	return lirs_init(max_elements);
+}
+
+static void * p_lirs_insert(void *cache, uint64 key, uint64 *removed_key)
+{
+	return lirs_insert(cache, key, removed_key);
+}
+
+static uint32 p_lirs_bump(void *cache, void *ele)
+{
+	return lirs_bump(cache, ele);
+}
+
+static uint32 p_lirs_num_elements(void *cache)
+{
+	return lirs_num_elements(cache);
+}
+
+static uint64 p_lirs_memory(void *cache)
+{
+	return lirs_memory(cache);
+}
+
+static void p_lirs_destroy(void *cache)
+{
+	lirs_destroy(cache);
+}
+
+/* ----------------------- sieve ----------------------- */
+
+static void * p_sieve_init(uint32 max_elements)
+{
+	return sieve_init(max_elements);
+}
+
+static void * p_sieve_insert(void *cache, uint64 key, uint64 *removed_key)
+{
+	return sieve_insert(cache, key, removed_key);
+}
+
+static uint32 p_sieve_bump(void *cache, void *ele)
+{
+	return sieve_bump(cache, ele);
+}
+
+static uint32 p_sieve_num_elements(void *cache)
+{
+	return sieve_num_elements(cache);
+}
+
+static uint64 p_sieve_memory(void *cache)
+{
+	return sieve_memory(cache);
+}
+
+static void p_sieve_destroy(void *cache)
+{
+	sieve_destroy(cache);
+}
+
+/* ----------------------- s3-fifo ----------------------- */
+
+static void * p_s3fifo_init(uint32 max_elements)
+{
+	return s3fifo_init(max_elements);
+}
+
+static void * p_s3fifo_insert(void *cache, uint64 key, uint64 *removed_key)
+{
+	return s3fifo_insert(cache, key, removed_key);
+}
+
+static uint32 p_s3fifo_bump(void *cache, void *ele)
+{
+	return s3fifo_bump(cache, ele);
+}
+
+static uint32 p_s3fifo_num_elements(void *cache)
+{
+	return s3fifo_num_elements(cache);
+}
+
+static uint64 p_s3fifo_memory(void *cache)
+{
+	return s3fifo_memory(cache);
+}
+
+static void p_s3fifo_destroy(void *cache)
+{
+	s3fifo_destroy(cache);
+}
+
+struct policy policies[] = {
+	{"lru", p_lru_init, p_lru_insert, p_lru_bump, p_lru_num_elements, p_lru_memory, p_lru_destroy},
+	{"clock", p_clock_init, p_clock_insert, p_clock_bump, p_clock_num_elements, p_clock_memory, p_clock_destroy},
+	{"clockpro", p_clockpro_init, p_clockpro_insert, p_clockpro_bump, p_clockpro_num_elements, p_clockpro_memory, p_clockpro_destroy},
+	{"arc", p_arc_init, p_arc_insert, p_arc_bump, p_arc_num_elements, p_arc_memory, p_arc_destroy},
+	{"2q", p_twoq_init, p_twoq_insert, p_twoq_bump, p_twoq_num_elements, p_twoq_memory, p_twoq_destroy},
+	{"lirs", p_lirs_init, p_lirs_insert, p_lirs_bump, p_lirs_num_elements, p_lirs_memory, p_lirs_destroy},
+	{"sieve", p_sieve_init, p_sieve_insert, p_sieve_bump, p_sieve_num_elements, p_sieve_memory, p_sieve_destroy},
+	{"s3fifo", p_s3fifo_init, p_s3fifo_insert, p_s3fifo_bump, p_s3fifo_num_elements, p_s3fifo_memory, p_s3fifo_destroy},
+	{NULL},
+};
+
+struct policy * policy_find(const char *name)
+{
+	struct policy * p;
+
+	for (p = policies; p->name; p++) {
+		if (!strcmp(p->name, name)) {
+			return p;
+		}
+	}
+	return NULL;
+}
+
+void policy_list(FILE *fp)
+{
+	struct policy * p;
+
+	for (p = policies; p->name; p++) {
+		fprintf(fp, "%s%s", p == policies ? "" : " ", p->name);
+	}
+	fprintf(fp, "\n");
+}
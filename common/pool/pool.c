@@ -0,0 +1,103 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+#include "pool.h"
+
+#define POOL_ALIGN	(sizeof(void *))
+#define POOL_DEFAULT_SLAB	(4096)
+
+struct pool * pool_init(uint32 elem_size, uint32 elems_per_slab)
+{
+	struct pool * pool = malloc(sizeof(*pool));
+	if (pool == NULL) {
+		return NULL;
+	}
+	memset(pool, 0, sizeof(*pool));
+	// free objects hold the free list link
+	if (elem_size < sizeof(void *)) {
+		elem_size = sizeof(void *);
+	}
+	pool->elem_size = (elem_size + POOL_ALIGN - 1) & ~(POOL_ALIGN - 1);
+	pool->elems_per_slab = elems_per_slab ? elems_per_slab : POOL_DEFAULT_SLAB;
+	return pool;
+}
+
+static uint32 pool_grow(struct pool *pool)
+{
+	struct pool_slab * slab = malloc(sizeof(*slab) +
+			(size_t)pool->elem_size*pool->elems_per_slab);
+	if (slab == NULL) {
+		return FAILURE;
+	}
+	slab->next = pool->slabs;
+	pool->slabs = slab;
+	pool->next_free = (char *)(slab + 1);
+	pool->slab_left = pool->elems_per_slab;
+	pool->nslabs++;
+	return SUCCESS;
+}
+
+void * pool_alloc(struct pool *pool)
+{
+	void * ptr;
+
+	if (pool->free_list) {
+		ptr = pool->free_list;
+		pool->free_list = *(void **)ptr;
+	} else {
+		if (pool->slab_left == 0 && !pool_grow(pool)) {
+			return NULL;
+		}
+		ptr = pool->next_free;
+		pool->next_free += pool->elem_size;
+		pool->slab_left--;
+	}
+	pool->nallocs++;
+	if (++pool->in_use > pool->peak) {
+		pool->peak = pool->in_use;
+	}
+	return ptr;
+}
+
+void pool_free(struct pool *pool, void *ptr)
+{
+	if (ptr == NULL) {
+		return;
+	}
+	*(void **)ptr = pool->free_list;
+	pool->free_list = ptr;
+	pool->nfrees++;
+	pool->in_use--;
+}
+
+/*
+ * releases every object of the pool at once.
+ */
+void pool_destroy(struct pool *pool)
+{
+	struct pool_slab * slab;
+
+	if (pool == NULL) {
+		return;
+	}
+	while (pool->slabs) {
+		slab = pool->slabs;
+		pool->slabs = slab->next;
+		free(slab);
+	}
+	free(pool);
+}
+
+uint64 pool_bytes(struct pool *pool)
+{
+	return pool->nslabs*(sizeof(struct pool_slab) +
+			(uint64)pool->elem_size*pool->elems_per_slab);
+}
+
+void pool_print_stats(struct pool *pool, const char *name, FILE *fp)
+{
+	fprintf(fp, "pool %s: elem %u slabs %llu bytes %llu allocs %llu frees %llu in_use %llu peak %llu\n",
+			name, pool->elem_size, pool->nslabs, pool_bytes(pool),
+			pool->nallocs, pool->nfrees, pool->in_use, pool->peak);
+}
@@ -0,0 +1,144 @@
+
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+#include "hash_funcs.h"
+#include "s3fifo.h"
+
+#define LEN(s3, l)	((s3)->lists[l].n)
+#define TAIL(s3, l)	dlist_entry((s3)->lists[l].tail, struct s3fifo_ele, node)
+#define FREQ(ele)	__atomic_load_n(&(ele)->freq, __ATOMIC_RELAXED)
+
+static void move_to(struct s3fifo *s3, struct s3fifo_ele *ele, uint32 list)
+{
+	dlist_remove(&s3->lists[ele->list], &ele->node);
+	ele->list = list;
+	dlist_push_head(&s3->lists[list], &ele->node);
+}
+
+/* moves small's tail to main or evicts it to the ghost fifo */
+static uint32 evict_small(struct s3fifo *s3, uint64 *removed_key)
+{
+	struct s3fifo_ele * ele;
+
+	while (LEN(s3, S3FIFO_SMALL)) {
+		ele = TAIL(s3, S3FIFO_SMALL);
+		if (FREQ(ele) > 1) {
+			ele->freq = 0;
+			move_to(s3, ele, S3FIFO_MAIN);
+			continue;
+		}
+		*removed_key = ele->key;
+		move_to(s3, ele, S3FIFO_GHOST);
+		hash_insert(s3->ghosts, ele->key, ele);
+		// the ghost fifo remembers as many keys as main holds
+		if (LEN(s3, S3FIFO_GHOST) > s3->max_elements - s3->small_max) {
+			ele = TAIL(s3, S3FIFO_GHOST);
+			dlist_remove(&s3->lists[S3FIFO_GHOST], &ele->node);
+			hash_delete(s3->ghosts, ele->key, NULL);
+			pool_free(s3->pool, ele);
+		}
+		return SUCCESS;
+	}
+	return FAILURE;
+}
+
+static void evict_main(struct s3fifo *s3, uint64 *removed_key)
+{
+	struct s3fifo_ele * ele;
+
+	for (;;) {
+		ele = TAIL(s3, S3FIFO_MAIN);
+		if (FREQ(ele)) {
+			ele->freq = FREQ(ele) - 1;
+			dlist_move_head(&s3->lists[S3FIFO_MAIN], &ele->node);
+			continue;
+		}
+		*removed_key = ele->key;
+		dlist_remove(&s3->lists[S3FIFO_MAIN], &ele->node);
+		pool_free(s3->pool, ele);
+		return;
+	}
+}
+
+struct s3fifo * s3fifo_init (uint32 max_elements)
+{
+	struct s3fifo * s3;
+
+	if (max_elements == 0) {
+		return NULL;
+	}
+	s3 = malloc(sizeof(*s3));
+	if (s3 == NULL) {
+		return NULL;
+	}
+	memset(s3, 0, sizeof(*s3));
+	s3->max_elements = max_elements;
+	s3->small_max = max_elements/10 ? max_elements/10 : 1;
+	s3->pool = pool_init(sizeof(struct s3fifo_ele), 0);
+	s3->ghosts = hash_init(1024, HASH_OPEN, hash_murmur);
+	if (s3->pool == NULL || s3->ghosts == NULL) {
+		s3fifo_destroy(s3);
+		return NULL;
+	}
+	return s3;
+}
+
+struct s3fifo_ele* s3fifo_insert (struct s3fifo *s3, uint64 key, uint64 *removed_key)
+{
+	struct s3fifo_ele * ele;
+	void * data;
+
+	*removed_key = INVALID_KEY;
+	if (s3fifo_num_elements(s3) == s3->max_elements) {
+		if (LEN(s3, S3FIFO_SMALL) < s3->small_max || !evict_small(s3, removed_key)) {
+			evict_main(s3, removed_key);
+		}
+	}
+	if (hash_delete(s3->ghosts, key, &data)) {
+		ele = data;
+		ele->freq = 0;
+		move_to(s3, ele, S3FIFO_MAIN);
+		return ele;
+	}
+	ele = pool_alloc(s3->pool);
+	if (ele == NULL) {
+		return NULL;
+	}
+	ele->key = key;
+	ele->freq = 0;
+	ele->list = S3FIFO_SMALL;
+	dlist_push_head(&s3->lists[S3FIFO_SMALL], &ele->node);
+	return ele;
+}
+
+uint32 s3fifo_bump (struct s3fifo *s3, struct s3fifo_ele *ele)
+{
+	uint32 freq = FREQ(ele);
+
+	// a lost update under a race only costs one count
+	if (freq < S3FIFO_FREQ_MAX) {
+		__atomic_store_n(&ele->freq, freq + 1, __ATOMIC_RELAXED);
+	}
+	return SUCCESS;
+}
+
+uint32 s3fifo_num_elements (struct s3fifo *s3)
+{
+	return LEN(s3, S3FIFO_SMALL) + LEN(s3, S3FIFO_MAIN);
+}
+
+uint64 s3fifo_memory (struct s3fifo *s3)
+{
+	return sizeof(*s3) + pool_bytes(s3->pool) + hash_memory(s3->ghosts);
+}
+
+void s3fifo_destroy (struct s3fifo *s3)
+{
+	if (s3 == NULL) {
+		return;
+	}
+	pool_destroy(s3->pool);
+	hash_destroy(s3->ghosts);
+	free(s3);
+}
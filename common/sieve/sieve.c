@@ -0,0 +1,91 @@
+
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+#include "sieve.h"
+
+#define ELE(node)	dlist_entry(node, struct sieve_ele, node)
+
+static void evict(struct sieve *sieve, uint64 *removed_key)
+{
+	struct dlist_node * node = sieve->hand ? sieve->hand : sieve->fifo.tail;
+	struct sieve_ele * ele;
+
+	for (;;) {
+		ele = ELE(node);
+		if (!__atomic_load_n(&ele->visited, __ATOMIC_RELAXED)) {
+			break;
+		}
+		__atomic_store_n(&ele->visited, 0, __ATOMIC_RELAXED);
+		// towards the head, wrapping around to the tail
+		node = node->prev ? node->prev : sieve->fifo.tail;
+	}
+	sieve->hand = node->prev;
+	*removed_key = ele->key;
+	dlist_remove(&sieve->fifo, node);
+	pool_free(sieve->pool, ele);
+}
+
+struct sieve * sieve_init (uint32 max_elements)
+{
+	struct sieve * sieve;
+
+	if (max_elements == 0) {
+		return NULL;
+	}
+	sieve = malloc(sizeof(*sieve));
+	if (sieve == NULL) {
+		return NULL;
+	}
+	memset(sieve, 0, sizeof(*sieve));
+	sieve->max_elements = max_elements;
+	sieve->pool = pool_init(sizeof(struct sieve_ele), 0);
+	if (sieve->pool == NULL) {
+		free(sieve);
+		return NULL;
+	}
+	return sieve;
+}
+
+struct sieve_ele* sieve_insert (struct sieve *sieve, uint64 key, uint64 *removed_key)
+{
+	struct sieve_ele * ele;
+
+	*removed_key = INVALID_KEY;
+	if (sieve->fifo.n == sieve->max_elements) {
+		evict(sieve, removed_key);
+	}
+	ele = pool_alloc(sieve->pool);
+	if (ele == NULL) {
+		return NULL;
+	}
+	ele->key = key;
+	ele->visited = 0;
+	dlist_push_head(&sieve->fifo, &ele->node);
+	return ele;
+}
+
+uint32 sieve_bump (struct sieve *sieve, struct sieve_ele *ele)
+{
+	__atomic_store_n(&ele->visited, 1, __ATOMIC_RELAXED);
+	return SUCCESS;
+}
+
+uint32 sieve_num_elements (struct sieve *sieve)
+{
+	return sieve->fifo.n;
+}
+
+uint64 sieve_memory (struct sieve *sieve)
+{
+	return sizeof(*sieve) + pool_bytes(sieve->pool);
+}
+
+void sieve_destroy (struct sieve *sieve)
+{
+	if (sieve == NULL) {
+		return;
+	}
+	pool_destroy(sieve->pool);
+	free(sieve);
+}
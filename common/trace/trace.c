@@ -0,0 +1,618 @@
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#include "types.h"
+#include "trace.h"
+
+/* more compressed input in zin_pos..zin_end, FAILURE at its end */
+static uint32 raw_more(struct trace *trace)
+{
+	ssize_t n;
+
+	if (trace->zin_pos < trace->zin_end) {
+		return SUCCESS;
+	}
+	if (trace->zin_eof) {
+		return FAILURE;
+	}
+	n = read(trace->fd, trace->zin, TRACE_BUF_SIZE);
+	if (n <= 0) {
+		trace->zin_eof = 1;
+		return FAILURE;
+	}
+	trace->zin_pos = trace->zin;
+	trace->zin_end = trace->zin + n;
+	return SUCCESS;
+}
+
+static ssize_t gz_read(struct trace *trace, char *dst, uint64 len)
+{
+	z_stream * zs = trace->zstream;
+	int ret;
+
+	zs->next_out = (Bytef *)dst;
+	zs->avail_out = len;
+	while (zs->avail_out) {
+		// with the input gone inflate may still hold output
+		raw_more(trace);
+		// avail_in is 32 bits, a mapped file is fed a GB at a time
+		zs->next_in = (Bytef *)trace->zin_pos;
+		zs->avail_in = trace->zin_end - trace->zin_pos < (1 << 30) ?
+			trace->zin_end - trace->zin_pos : (1 << 30);
+		ret = inflate(zs, Z_NO_FLUSH);
+		trace->zin_pos = (char *)zs->next_in;
+		if (ret == Z_STREAM_END) {
+			// gzip members can be concatenated
+			if (!raw_more(trace)) {
+				break;
+			}
+			inflateReset(zs);
+		} else if (ret == Z_BUF_ERROR) {
+			// no input and nothing held back
+			break;
+		} else if (ret != Z_OK) {
+			// corrupt, the trace ends here
+			trace->zin_pos = trace->zin_end;
+			trace->zin_eof = 1;
+			break;
+		}
+	}
+	return len - zs->avail_out;
+}
+
+#ifdef HAVE_ZSTD
+static ssize_t zstd_read(struct trace *trace, char *dst, uint64 len)
+{
+	ZSTD_outBuffer out = { dst, len, 0 };
+	ZSTD_inBuffer in;
+	size_t ret, done;
+
+	while (out.pos < out.size) {
+		// with the input gone the decoder may still hold output
+		raw_more(trace);
+		in.src = trace->zin_pos;
+		in.size = trace->zin_end - trace->zin_pos;
+		in.pos = 0;
+		done = out.pos;
+		ret = ZSTD_decompressStream(trace->zstream, &out, &in);
+		trace->zin_pos += in.pos;
+		if (!ZSTD_isError(ret) && in.size == 0 && out.pos == done) {
+			break;
+		}
+		if (ZSTD_isError(ret)) {
+			trace->zin_pos = trace->zin_end;
+			trace->zin_eof = 1;
+			break;
+		}
+	}
+	return out.pos;
+}
+#endif
+
+/* trace bytes, decompressed if need be */
+static ssize_t source_read(struct trace *trace, char *dst, uint64 len)
+{
+	if (trace->zip == TRACE_GZIP) {
+		return gz_read(trace, dst, len);
+	}
+#ifdef HAVE_ZSTD
+	if (trace->zip == TRACE_ZSTD) {
+		return zstd_read(trace, dst, len);
+	}
+#endif
+	return read(trace->fd, dst, len);
+}
+
+/*
+ * moves what is left to the front of buf and reads more. limit is put
+ * after the last newline, a line cut by the end of buf waits for the
+ * next read.
+ */
+static void refill(struct trace *trace)
+{
+	uint64 left = trace->end - trace->pos;
+	ssize_t n;
+	char * p;
+
+	// a line that fills the whole buffer is dropped
+	if (left == TRACE_BUF_SIZE) {
+		left = 0;
+	}
+	memmove(trace->buf, trace->pos, left);
+	trace->pos = trace->buf;
+	trace->end = trace->buf + left;
+	while (!trace->eof && trace->end < trace->buf + TRACE_BUF_SIZE) {
+		n = source_read(trace, trace->end, trace->buf + TRACE_BUF_SIZE - trace->end);
+		if (n <= 0) {
+			trace->eof = 1;
+			break;
+		}
+		trace->end += n;
+	}
+	// binary records are decoded up to the end of whatever is there
+	if (trace->eof || trace->binary) {
+		trace->limit = trace->end;
+		return;
+	}
+	for (p = trace->end; p > trace->pos && p[-1] != '\n'; p--);
+	trace->limit = p;
+}
+
+static uint32 check_binary(struct trace *trace)
+{
+	if (trace->end - trace->pos >= TRACE_BIN_HDR &&
+			!memcmp(trace->pos, TRACE_BIN_MAGIC, 4) &&
+			trace->pos[4] == TRACE_BIN_VERSION) {
+		trace->binary = 1;
+		trace->flags = (unsigned char)trace->pos[5];
+	}
+	return trace->binary;
+}
+
+/*
+ * a gzip or zstd trace: what was read so far becomes the compressed
+ * input and buf starts over with the decompressed bytes.
+ */
+static uint32 check_zip(struct trace *trace)
+{
+	unsigned char * p = (unsigned char *)trace->pos;
+	uint64 len = trace->end - trace->pos;
+	z_stream * zs;
+
+	if (len >= 2 && p[0] == 0x1f && p[1] == 0x8b) {
+		trace->zip = TRACE_GZIP;
+		zs = malloc(sizeof(*zs));
+		if (zs == NULL) {
+			return FAILURE;
+		}
+		memset(zs, 0, sizeof(*zs));
+		// 15 bit window, 16 for the gzip header
+		if (inflateInit2(zs, 15 + 16) != Z_OK) {
+			free(zs);
+			return FAILURE;
+		}
+		trace->zstream = zs;
+	} else if (len >= 4 && p[0] == 0x28 && p[1] == 0xb5 && p[2] == 0x2f && p[3] == 0xfd) {
+		trace->zip = TRACE_ZSTD;
+#ifdef HAVE_ZSTD
+		trace->zstream = ZSTD_createDStream();
+		if (trace->zstream == NULL) {
+			return FAILURE;
+		}
+		ZSTD_initDStream(trace->zstream);
+#else
+		fprintf(stderr, "zstd trace, build with ZSTD=1 to read it\n");
+		return FAILURE;
+#endif
+	} else {
+		return SUCCESS;
+	}
+	trace->zin = trace->buf;
+	trace->zin_pos = trace->pos;
+	trace->zin_end = trace->end;
+	trace->zin_eof = trace->eof;
+	trace->buf = malloc(TRACE_BUF_SIZE);
+	trace->queue = malloc(sizeof(struct trace_batch)*TRACE_QUEUE);
+	if (trace->buf == NULL || trace->queue == NULL) {
+		return FAILURE;
+	}
+	pthread_mutex_init(&trace->lock, NULL);
+	pthread_cond_init(&trace->not_empty, NULL);
+	pthread_cond_init(&trace->not_full, NULL);
+	trace->pos = trace->limit = trace->end = trace->buf;
+	trace->eof = 0;
+	refill(trace);
+	return SUCCESS;
+}
+
+/* skips up to the next digit, FAILURE if there is none before limit */
+static inline uint32 parse_uint(char **pos, char *limit, uint64 *val)
+{
+	char * p = *pos;
+	uint64 v = 0;
+
+	while (p < limit && (unsigned)(*p - '0') > 9) {
+		p++;
+	}
+	if (p == limit) {
+		return FAILURE;
+	}
+	do {
+		v = v*10 + (*p++ - '0');
+	} while (p < limit && (unsigned)(*p - '0') <= 9);
+	*val = v;
+	*pos = p;
+	return SUCCESS;
+}
+
+static inline uint32 parse_rec(char **pos, char *limit, struct trace_rec *rec)
+{
+	char * p = *pos;
+
+	if (!parse_uint(&p, limit, &rec->start) || !parse_uint(&p, limit, &rec->len)) {
+		return FAILURE;
+	}
+	while (p < limit && (*p == ' ' || *p == '\t')) {
+		p++;
+	}
+	if (p == limit) {
+		return FAILURE;
+	}
+	rec->rw = *p++;
+	*pos = p;
+	return SUCCESS;
+}
+
+static inline uint32 get_varint(char **pos, char *end, uint64 *val)
+{
+	unsigned char * p = (unsigned char *)*pos;
+	uint64 v = 0;
+	uint32 shift = 0;
+
+	do {
+		if ((char *)p == end || shift > 63) {
+			return FAILURE;
+		}
+		v |= (uint64)(*p & 0x7F) << shift;
+		shift += 7;
+	} while (*p++ & 0x80);
+	*val = v;
+	*pos = (char *)p;
+	return SUCCESS;
+}
+
+static inline uint32 decode_rec(struct trace *trace, char **pos, char *end, struct trace_rec *rec)
+{
+	char * p = *pos;
+	uint64 v, len, dt = 0;
+
+	if (!get_varint(&p, end, &v) || !get_varint(&p, end, &len) ||
+			((trace->flags & TRACE_BIN_TIME) && !get_varint(&p, end, &dt))) {
+		return FAILURE;
+	}
+	rec->rw = v & 1 ? 'W' : 'R';
+	v >>= 1;
+	// zigzag back to a signed delta
+	trace->prev_start += (v >> 1) ^ -(v & 1);
+	rec->start = trace->prev_start;
+	rec->len = len & 1 ? len >> 1 : (len >> 1)*512;
+	trace->prev_time += dt;
+	rec->time = trace->prev_time;
+	*pos = p;
+	return SUCCESS;
+}
+
+static uint32 bin_next_batch(struct trace *trace, struct trace_rec *recs, uint32 max)
+{
+	uint32 n = 0;
+
+	while (n < max) {
+		// no record is cut short unless the trace itself is
+		if (!trace->eof && trace->end - trace->pos < TRACE_BIN_MAXREC) {
+			refill(trace);
+		}
+		if (!decode_rec(trace, &trace->pos, trace->end, &recs[n])) {
+			trace->pos = trace->end;
+			break;
+		}
+		n++;
+	}
+	return n;
+}
+
+static uint32 read_size (struct trace *trace, uint64 *size)
+{
+	unsigned char * p;
+	uint32 i;
+
+	if (trace->binary) {
+		p = (unsigned char *)trace->pos;
+		*size = 0;
+		for (i = 0; i < 8; i++) {
+			*size |= (uint64)p[8 + i] << (8*i);
+		}
+		trace->pos += TRACE_BIN_HDR;
+		return SUCCESS;
+	}
+	if (trace->pos == trace->limit && !trace->eof) {
+		refill(trace);
+	}
+	return parse_uint(&trace->pos, trace->limit, size);
+}
+
+uint32 trace_read_size (struct trace *trace, uint64 *size)
+{
+	// a compressed trace had it read before its thread started
+	if (trace->zip) {
+		*size = trace->size;
+		return trace->size_ok;
+	}
+	return read_size(trace, size);
+}
+
+static uint32 parse_batch (struct trace *trace, struct trace_rec *recs, uint32 max)
+{
+	uint32 n = 0;
+
+	if (trace->binary) {
+		return bin_next_batch(trace, recs, max);
+	}
+	while (n < max) {
+		if (!parse_rec(&trace->pos, trace->limit, &recs[n])) {
+			if (trace->eof) {
+				// trailing garbage or a cut record, nothing more to read
+				trace->pos = trace->limit;
+				break;
+			}
+			refill(trace);
+			continue;
+		}
+		recs[n].time = 0;
+		n++;
+	}
+	return n;
+}
+
+/* decompresses and parses ahead of the reader, an empty batch ends it */
+static void * trace_thread(void *arg)
+{
+	struct trace * trace = arg;
+	struct trace_batch * b;
+	uint32 n;
+
+	do {
+		pthread_mutex_lock(&trace->lock);
+		while (trace->qtail - trace->qhead == TRACE_QUEUE && !trace->stop) {
+			pthread_cond_wait(&trace->not_full, &trace->lock);
+		}
+		if (trace->stop) {
+			pthread_mutex_unlock(&trace->lock);
+			break;
+		}
+		b = &trace->queue[trace->qtail % TRACE_QUEUE];
+		pthread_mutex_unlock(&trace->lock);
+
+		n = b->n = parse_batch(trace, b->recs, TRACE_BATCH);
+
+		pthread_mutex_lock(&trace->lock);
+		if (n) {
+			trace->qtail++;
+		} else {
+			trace->done = 1;
+		}
+		pthread_cond_signal(&trace->not_empty);
+		pthread_mutex_unlock(&trace->lock);
+	} while (n);
+	return NULL;
+}
+
+static uint32 queue_next_batch(struct trace *trace, struct trace_rec *recs, uint32 max)
+{
+	struct trace_batch * b;
+	uint32 n;
+
+	pthread_mutex_lock(&trace->lock);
+	while (trace->qhead == trace->qtail && !trace->done) {
+		pthread_cond_wait(&trace->not_empty, &trace->lock);
+	}
+	if (trace->qhead == trace->qtail) {
+		pthread_mutex_unlock(&trace->lock);
+		return 0;
+	}
+	b = &trace->queue[trace->qhead % TRACE_QUEUE];
+	pthread_mutex_unlock(&trace->lock);
+
+	n = b->n - trace->qoff < max ? b->n - trace->qoff : max;
+	memcpy(recs, b->recs + trace->qoff, sizeof(struct trace_rec)*n);
+	trace->qoff += n;
+	if (trace->qoff == b->n) {
+		trace->qoff = 0;
+		pthread_mutex_lock(&trace->lock);
+		trace->qhead++;
+		pthread_cond_signal(&trace->not_full);
+		pthread_mutex_unlock(&trace->lock);
+	}
+	return n;
+}
+
+/*
+ * the size comes first, the thread owns the buffer once it runs. a
+ * thread that cannot start fails the open, not the first batch.
+ */
+static uint32 start_thread(struct trace *trace)
+{
+	trace->size_ok = read_size(trace, &trace->size);
+	if (pthread_create(&trace->thread, NULL, trace_thread, trace)) {
+		fprintf(stderr, "Cannot start the trace decompression thread\n");
+		return FAILURE;
+	}
+	trace->started = 1;
+	return SUCCESS;
+}
+
+struct trace * trace_open (const char *path)
+{
+	struct trace * trace = malloc(sizeof(*trace));
+	struct stat st;
+
+	if (trace == NULL) {
+		return NULL;
+	}
+	memset(trace, 0, sizeof(*trace));
+	trace->fd = 0;
+	if (path && strcmp(path, "-")) {
+		trace->fd = open(path, O_RDONLY);
+		if (trace->fd < 0) {
+			free(trace);
+			return NULL;
+		}
+	}
+	// stdin redirected from a file gets mapped too
+	if (fstat(trace->fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+		trace->map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, trace->fd, 0);
+		if (trace->map == MAP_FAILED) {
+			trace->map = NULL;
+		} else {
+			madvise(trace->map, st.st_size, MADV_SEQUENTIAL);
+			trace->map_len = st.st_size;
+			trace->pos = trace->map;
+			trace->limit = trace->end = trace->map + st.st_size;
+			trace->eof = 1;
+			if (!check_zip(trace)) {
+				trace_close(trace);
+				return NULL;
+			}
+			if (check_binary(trace) && trace->buf) {
+				trace->limit = trace->end;
+			}
+			if (trace->zip && !start_thread(trace)) {
+				trace_close(trace);
+				return NULL;
+			}
+			return trace;
+		}
+	}
+	trace->buf = malloc(TRACE_BUF_SIZE);
+	if (trace->buf == NULL) {
+		trace_close(trace);
+		return NULL;
+	}
+	trace->pos = trace->limit = trace->end = trace->buf;
+	refill(trace);
+	if (!check_zip(trace)) {
+		trace_close(trace);
+		return NULL;
+	}
+	if (check_binary(trace)) {
+		trace->limit = trace->end;
+	}
+	if (trace->zip && !start_thread(trace)) {
+		trace_close(trace);
+		return NULL;
+	}
+	return trace;
+}
+
+uint32 trace_next_batch (struct trace *trace, struct trace_rec *recs, uint32 max)
+{
+	uint32 n;
+
+	n = trace->zip ? queue_next_batch(trace, recs, max) : parse_batch(trace, recs, max);
+	trace->records += n;
+	return n;
+}
+
+void trace_close (struct trace *trace)
+{
+	if (trace == NULL) {
+		return;
+	}
+	if (trace->started) {
+		pthread_mutex_lock(&trace->lock);
+		trace->stop = 1;
+		pthread_cond_signal(&trace->not_full);
+		pthread_mutex_unlock(&trace->lock);
+		pthread_join(trace->thread, NULL);
+	}
+	if (trace->zip == TRACE_GZIP && trace->zstream) {
+		inflateEnd(trace->zstream);
+		free(trace->zstream);
+	}
+#ifdef HAVE_ZSTD
+	if (trace->zip == TRACE_ZSTD && trace->zstream) {
+		ZSTD_freeDStream(trace->zstream);
+	}
+#endif
+	if (trace->map) {
+		munmap(trace->map, trace->map_len);
+	}
+	// a mapped trace is its own compressed input
+	if (!trace->map) {
+		free(trace->zin);
+	}
+	free(trace->queue);
+	free(trace->buf);
+	if (trace->fd > 0) {
+		close(trace->fd);
+	}
+	free(trace);
+}
+
+static uint32 put_varint(struct trace_writer *tw, uint64 v)
+{
+	unsigned char b[10];
+	uint32 n = 0;
+
+	while (v >= 0x80) {
+		b[n++] = (v & 0x7F) | 0x80;
+		v >>= 7;
+	}
+	b[n++] = v;
+	tw->bytes += n;
+	return fwrite(b, 1, n, tw->fp) == n;
+}
+
+struct trace_writer * trace_writer_open (FILE *fp, uint64 size, uint32 flags)
+{
+	struct trace_writer * tw = malloc(sizeof(*tw));
+	unsigned char hdr[TRACE_BIN_HDR];
+	uint32 i;
+
+	if (tw == NULL) {
+		return NULL;
+	}
+	memset(tw, 0, sizeof(*tw));
+	tw->fp = fp;
+	tw->flags = flags;
+	memset(hdr, 0, sizeof(hdr));
+	memcpy(hdr, TRACE_BIN_MAGIC, 4);
+	hdr[4] = TRACE_BIN_VERSION;
+	hdr[5] = flags;
+	for (i = 0; i < 8; i++) {
+		hdr[8 + i] = size >> (8*i);
+	}
+	if (fwrite(hdr, 1, sizeof(hdr), fp) != sizeof(hdr)) {
+		free(tw);
+		return NULL;
+	}
+	tw->bytes = sizeof(hdr);
+	return tw;
+}
+
+uint32 trace_write (struct trace_writer *tw, struct trace_rec *rec)
+{
+	uint64 delta = rec->start - tw->prev_start;
+	uint32 w = rec->rw == 'W' || rec->rw == 'w';
+	uint32 ret;
+
+	// zigzag keeps small backward jumps small
+	delta = (delta << 1) ^ -(delta >> 63);
+	tw->prev_start = rec->start;
+	ret = put_varint(tw, delta << 1 | w);
+	if (rec->len % 512 == 0) {
+		ret &= put_varint(tw, rec->len/512 << 1);
+	} else {
+		ret &= put_varint(tw, rec->len << 1 | 1);
+	}
+	if (tw->flags & TRACE_BIN_TIME) {
+		ret &= put_varint(tw, rec->time - tw->prev_time);
+		tw->prev_time = rec->time;
+	}
+	return ret;
+}
+
+uint32 trace_writer_close (struct trace_writer *tw)
+{
+	uint32 ret = fflush(tw->fp) == 0;
+
+	free(tw);
+	return ret;
+}
@@ -0,0 +1,117 @@
+
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+#include "hash_funcs.h"
+#include "twoq.h"
+
+#define LEN(q, l)	((q)->lists[l].n)
+#define TAIL(q, l)	dlist_entry((q)->lists[l].tail, struct twoq_ele, node)
+
+static void reclaim(struct twoq *q, uint64 *removed_key)
+{
+	struct twoq_ele * ele;
+
+	if (LEN(q, TWOQ_A1IN) > q->kin || LEN(q, TWOQ_AM) == 0) {
+		ele = TAIL(q, TWOQ_A1IN);
+		*removed_key = ele->key;
+		dlist_remove(&q->lists[TWOQ_A1IN], &ele->node);
+		ele->list = TWOQ_A1OUT;
+		dlist_push_head(&q->lists[TWOQ_A1OUT], &ele->node);
+		hash_insert(q->ghosts, ele->key, ele);
+		if (LEN(q, TWOQ_A1OUT) > q->kout) {
+			ele = TAIL(q, TWOQ_A1OUT);
+			dlist_remove(&q->lists[TWOQ_A1OUT], &ele->node);
+			hash_delete(q->ghosts, ele->key, NULL);
+			pool_free(q->pool, ele);
+		}
+		return;
+	}
+	ele = TAIL(q, TWOQ_AM);
+	*removed_key = ele->key;
+	dlist_remove(&q->lists[TWOQ_AM], &ele->node);
+	pool_free(q->pool, ele);
+}
+
+struct twoq * twoq_init (uint32 max_elements)
+{
+	struct twoq * q;
+
+	if (max_elements == 0) {
+		return NULL;
+	}
+	q = malloc(sizeof(*q));
+	if (q == NULL) {
+		return NULL;
+	}
+	memset(q, 0, sizeof(*q));
+	q->max_elements = max_elements;
+	q->kin = max_elements/4 ? max_elements/4 : 1;
+	q->kout = max_elements/2 ? max_elements/2 : 1;
+	q->pool = pool_init(sizeof(struct twoq_ele), 0);
+	q->ghosts = hash_init(1024, HASH_OPEN, hash_murmur);
+	if (q->pool == NULL || q->ghosts == NULL) {
+		twoq_destroy(q);
+		return NULL;
+	}
+	return q;
+}
+
+struct twoq_ele* twoq_insert (struct twoq *q, uint64 key, uint64 *removed_key)
+{
+	struct twoq_ele * ele;
+	void * data;
+
+	*removed_key = INVALID_KEY;
+	if (hash_delete(q->ghosts, key, &data)) {
+		// reclaiming first could drop this very key off a1out
+		ele = data;
+		dlist_remove(&q->lists[TWOQ_A1OUT], &ele->node);
+		if (twoq_num_elements(q) == q->max_elements) {
+			reclaim(q, removed_key);
+		}
+		ele->list = TWOQ_AM;
+		dlist_push_head(&q->lists[TWOQ_AM], &ele->node);
+		return ele;
+	}
+	if (twoq_num_elements(q) == q->max_elements) {
+		reclaim(q, removed_key);
+	}
+	ele = pool_alloc(q->pool);
+	if (ele == NULL) {
+		return NULL;
+	}
+	ele->key = key;
+	ele->list = TWOQ_A1IN;
+	dlist_push_head(&q->lists[TWOQ_A1IN], &ele->node);
+	return ele;
+}
+
+/* a1in is a fifo, only am blocks move on a hit */
+uint32 twoq_bump (struct twoq *q, struct twoq_ele *ele)
+{
+	if (ele->list == TWOQ_AM) {
+		dlist_move_head(&q->lists[TWOQ_AM], &ele->node);
+	}
+	return SUCCESS;
+}
+
+uint32 twoq_num_elements (struct twoq *q)
+{
+	return LEN(q, TWOQ_A1IN) + LEN(q, TWOQ_AM);
+}
+
+uint64 twoq_memory (struct twoq *q)
+{
+	return sizeof(*q) + pool_bytes(q->pool) + hash_memory(q->ghosts);
+}
+
+void twoq_destroy (struct twoq *q)
+{
+	if (q == NULL) {
+		return;
+	}
+	pool_destroy(q->pool);
+	hash_destroy(q->ghosts);
+	free(q);
+}
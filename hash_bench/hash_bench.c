@@ -0,0 +1,193 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "types.h"
+#include "trace.h"
+#include "hash.h"
+#include "hash_funcs.h"
+
+#define BLOCK_SIZE (512)
+#define MAX_CHAIN	(8)
+/* keys per batch call, small enough for the output to stay in L1 */
+#define BENCH_BATCH	(256)
+
+uint64 *keys = NULL;
+uint64 nkeys = 0;
+
+/* stdin through the trace reader, a batch at a time */
+struct trace *trace = NULL;
+struct trace_rec recs[TRACE_BATCH];
+uint32 nrecs = 0, next_rec = 0;
+
+void get_size ()
+{
+	uint64 size;
+
+	trace = trace_open(NULL);
+	if (!trace || !trace_read_size(trace, &size)) {
+		printf("Cannot read the trace\n");
+		exit(-1);
+	}
+}
+
+int read_spc_trace(uint64 *start, uint64 *len, char *rw)
+{
+	if (next_rec == nrecs) {
+		nrecs = trace_next_batch(trace, recs, TRACE_BATCH);
+		next_rec = 0;
+		if (nrecs == 0) {
+			return EOF;
+		}
+	}
+	*start = recs[next_rec].start;
+	*len = recs[next_rec].len;
+	*rw = recs[next_rec].rw;
+	next_rec++;
+	return 3;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+/*
+ * every block of every request, in trace order, up to max keys.
+ */
+static void load_keys(uint64 max, uint64 cache_bs)
+{
+	uint64 start, len, first, last, k;
+	char rw;
+
+	keys = malloc(sizeof(uint64)*max);
+	if (keys == NULL) {
+		printf("No  mem available\n");
+		exit(-1);
+	}
+	get_size();
+	while (nkeys < max && read_spc_trace(&start, &len, &rw) != EOF) {
+		if (len < BLOCK_SIZE)	continue;
+		first = start*BLOCK_SIZE/cache_bs;
+		last = (start*BLOCK_SIZE + len/BLOCK_SIZE*BLOCK_SIZE - 1)/cache_bs;
+		for (k = first; k <= last && nkeys < max; k++) {
+			keys[nkeys++] = k;
+		}
+	}
+}
+
+static void bench(struct hash_func_desc *desc, uint32 rounds)
+{
+	struct hash_table * table;
+	uint64 hist[MAX_CHAIN + 1];
+	uint64 out[BENCH_BATCH];
+	uint64 i, sum = 0, n, used = 0, max = 0;
+	double t, scalar, batch;
+	uint32 r;
+
+	t = now();
+	for (r = 0; r < rounds; r++) {
+		for (i = 0; i < nkeys; i++) {
+			sum += desc->func(NULL, keys[i]);
+		}
+	}
+	scalar = (now() - t)*1e9/nkeys/rounds;
+	t = now();
+	for (r = 0; r < rounds; r++) {
+		for (i = 0; i < nkeys; i += n) {
+			n = nkeys - i < BENCH_BATCH ? nkeys - i : BENCH_BATCH;
+			desc->batch(keys + i, n, out);
+			sum += out[0];
+		}
+	}
+	batch = (now() - t)*1e9/nkeys/rounds;
+
+	// chain lengths once the distinct blocks are in a chained table
+	table = hash_init(1024, HASH_CHAINED, desc->func);
+	for (i = 0; i < nkeys; i++) {
+		hash_insert(table, keys[i], NULL);
+	}
+	// the last insert may have left part of a resize in the old buckets
+	hash_rehash_finish(table);
+	memset(hist, 0, sizeof(hist));
+	for (i = 0; i < table->num_tables; i++) {
+		n = hash_num_elements_bucket(table, i);
+		hist[n < MAX_CHAIN ? n : MAX_CHAIN]++;
+		if (n)	used++;
+		if (n > max)	max = n;
+	}
+	printf("%-10s %8.2f %8.2f %10u %10u %8.3f %6lld",
+			desc->name, scalar, batch, hash_num_elements(table),
+			table->num_tables, (double)hash_num_elements(table)/used, max);
+	for (i = 0; i <= MAX_CHAIN; i++) {
+		printf(" %5.1f", hist[i]*100.0/table->num_tables);
+	}
+	printf("\n");
+	// keeps the compiler from dropping the timed loops
+	if (sum == 1)	printf("\n");
+	hash_destroy(table);
+}
+
+int main(int argc, char **argv)
+{
+	struct hash_func_desc * desc = NULL;
+	uint64 max = 10000000;
+	uint64 cache_bs = BLOCK_SIZE;
+	uint32 rounds = 10, i;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "F:n:r:b:")) != -1) {
+		switch (opt) {
+		case 'F':
+			desc = hash_func_find(optarg);
+			if (!desc) {
+				printf("Unknown hash function %s, one of: ", optarg);
+				hash_func_list(stdout);
+				return -1;
+			}
+			break;
+		case 'n':
+			max = strtoull(optarg, NULL, 0);
+			break;
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+		case 'b':
+			cache_bs = strtoull(optarg, NULL, 0);
+			break;
+		default:
+			printf("Usage: ./hash_bench [-F hash function] [-n max keys] [-r rounds] [-b block bytes] < trace\n");
+			return -1;
+		}
+	}
+	if (cache_bs == 0 || rounds == 0) {
+		printf("Invalid block size or rounds\n");
+		return -1;
+	}
+	load_keys(max, cache_bs);
+	if (nkeys == 0) {
+		printf("No blocks in trace\n");
+		return -1;
+	}
+	printf("%lld keys\n", nkeys);
+	printf("%-10s %8s %8s %10s %10s %8s %6s", "hash", "ns/op", "batch", "distinct",
+			"buckets", "avgchain", "max");
+	for (i = 0; i <= MAX_CHAIN; i++) {
+		printf("   %%=%d", i);
+	}
+	printf("+\n");
+	if (desc) {
+		bench(desc, rounds);
+	} else {
+		for (desc = hash_func_find("identity"); desc->name; desc++) {
+			bench(desc, rounds);
+		}
+	}
+	free(keys);
+	return 0;
+}
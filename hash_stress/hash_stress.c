@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "types.h"
+#include "hash.h"
+#include "shard_hash.h"
+#include "prng.h"
+
+#define MAX_THREADS	(256)
+
+struct shard_hash *sh = NULL;
+uint32 nthreads = 0;
+uint64 ops = 1000000;
+uint64 nkeys = 1000000;
+uint32 read_pct = 80;
+uint32 errors = 0;
+
+struct worker {
+	pthread_t thread;
+	uint32 id;
+	uint64 seed;
+	uint64 owned;
+	unsigned char *present;
+};
+
+uint64 hash_func (struct hash_table*table, uint64 key)
+{
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdULL;
+	key ^= key >> 33;
+	return key;
+}
+
+/*
+ * every thread only changes the keys k with k % nthreads == id, so it
+ * knows exactly which of them must be present and checks every answer.
+ */
+static void *worker(void *arg)
+{
+	struct worker * w = arg;
+	uint64 i, k, slot, r;
+	uint64 nslots = nkeys/nthreads;
+	void * data;
+
+	for (i = 0; i < ops; i++) {
+		r = prng_next(&w->seed);
+		slot = (r >> 8) % nslots;
+		k = slot*nthreads + w->id;
+		if ((r & 0xFF)*100 < read_pct*256) {
+			if (shard_hash_lookup(sh, k, &data) != w->present[slot] ||
+					(w->present[slot] && data != (void *)(k + 1))) {
+				__sync_fetch_and_add(&errors, 1);
+			}
+		} else if (w->present[slot]) {
+			if (!shard_hash_delete(sh, k, NULL)) {
+				__sync_fetch_and_add(&errors, 1);
+			}
+			w->present[slot] = 0;
+			w->owned--;
+		} else {
+			if (!shard_hash_insert(sh, k, (void *)(k + 1))) {
+				__sync_fetch_and_add(&errors, 1);
+			}
+			w->present[slot] = 1;
+			w->owned++;
+		}
+	}
+	return NULL;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+static double run(uint32 threads, uint32 nshards, uint32 flags)
+{
+	struct worker w[MAX_THREADS];
+	uint64 owned = 0;
+	double start, elapsed;
+	uint32 i;
+
+	nthreads = threads;
+	sh = shard_hash_init(nshards, 1024, flags, hash_func);
+	if (!sh) {
+		printf("No  mem available\n");
+		exit(-1);
+	}
+	memset(w, 0, sizeof(w));
+	for (i = 0; i < threads; i++) {
+		w[i].id = i;
+		w[i].seed = 0x9e3779b97f4a7c15ULL*(i + 1);
+		w[i].present = calloc(nkeys/threads + 1, 1);
+	}
+	start = now();
+	for (i = 0; i < threads; i++) {
+		pthread_create(&w[i].thread, NULL, worker, &w[i]);
+	}
+	for (i = 0; i < threads; i++) {
+		pthread_join(w[i].thread, NULL);
+		owned += w[i].owned;
+		free(w[i].present);
+	}
+	elapsed = now() - start;
+	if (owned != shard_hash_num_elements(sh)) {
+		printf("element count mismatch %lld %lld\n", owned, shard_hash_num_elements(sh));
+		errors++;
+	}
+	shard_hash_destroy(sh);
+	return elapsed;
+}
+
+int main(int argc, char **argv)
+{
+	uint32 max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	uint32 nshards = 64;
+	uint32 flags = HASH_CHAINED;
+	uint32 t;
+	double elapsed, base = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "t:s:n:k:r:H:")) != -1) {
+		switch (opt) {
+		case 't':
+			max_threads = atoi(optarg);
+			break;
+		case 's':
+			nshards = atoi(optarg);
+			break;
+		case 'n':
+			ops = strtoull(optarg, NULL, 0);
+			break;
+		case 'k':
+			nkeys = strtoull(optarg, NULL, 0);
+			break;
+		case 'r':
+			read_pct = atoi(optarg);
+			break;
+		case 'H':
+			flags = strcmp(optarg, "open") ? HASH_CHAINED : HASH_OPEN;
+			break;
+		default:
+			printf("Usage: ./hash_stress [-t max threads] [-s shards] [-n ops per thread] [-k keys] [-r read pct] [-H chained|open]\n");
+			return -1;
+		}
+	}
+	if (max_threads == 0 || max_threads > MAX_THREADS || nkeys < max_threads) {
+		printf("Invalid thread count\n");
+		return -1;
+	}
+	printf("threads, Mops/s, speedup\n");
+	for (t = 1; ; t = (t << 1) > max_threads ? max_threads : t << 1) {
+		elapsed = run(t, nshards, flags);
+		if (t == 1)	base = ops/elapsed;
+		printf("%u, %.2f, %.2f\n", t, ops*t/elapsed/1e6, ops*t/elapsed/base);
+		if (t == max_threads)	break;
+	}
+	if (errors) {
+		printf("%u errors\n", errors);
+		return 1;
+	}
+	return 0;
+}
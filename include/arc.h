@@ -0,0 +1,42 @@
+#ifndef _ARC_H_
+#define _ARC_H_
+#include "types.h"
+#include "dlist.h"
+#include "hash.h"
+#include "pool.h"
+#include "lru.h"
+
+/*
+ * ARC (Megiddo, Modha, FAST 2003). t1 holds blocks seen once recently,
+ * t2 blocks seen at least twice, b1/b2 remember the keys evicted from
+ * them. a hit in b1 grows the target size p of t1, a hit in b2 shrinks
+ * it, so a scan only ever pushes out the t1 share of the cache.
+ */
+#define ARC_T1	0
+#define ARC_T2	1
+#define ARC_B1	2
+#define ARC_B2	3
+
+struct arc_ele {
+	struct dlist_node node;
+	uint64 key;
+	uint32 list;
+};
+
+struct arc {
+	struct dlist lists[4];
+	/* keys on b1 and b2 -> ele */
+	struct hash_table *ghosts;
+	struct pool *pool;
+	uint32 max_elements;
+	uint32 p;
+};
+
+struct arc * arc_init (uint32 max_elements);
+struct arc_ele* arc_insert (struct arc *arc, uint64 key, uint64 *removed_key);
+uint32 arc_bump (struct arc *arc, struct arc_ele *ele);
+uint32 arc_num_elements (struct arc *arc);
+uint64 arc_memory (struct arc *arc);
+void arc_destroy (struct arc *arc);
+
+#endif
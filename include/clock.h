@@ -0,0 +1,73 @@
+#ifndef _CLOCK_H_
+#define _CLOCK_H_
+#include "types.h"
+#include "hash.h"
+#include "lru.h"
+
+/*
+ * CLOCK: fixed ring of slots, a hit only sets the reference bit. on a
+ * miss the hand clears set bits until it finds a clear one, that slot is
+ * evicted and reused for the new key.
+ */
+struct clock_ele {
+	uint64 key;
+	uint32 ref;
+};
+
+struct clock {
+	struct clock_ele *eles;
+	uint32 max_elements;
+	uint32 nelements;
+	uint32 hand;
+};
+
+struct clock * clock_init (uint32 max_elements);
+struct clock_ele* clock_insert (struct clock *clock, uint64 key, uint64 *removed_key);
+uint32 clock_bump (struct clock *clock, struct clock_ele *ele);
+uint64 clock_memory (struct clock *clock);
+void clock_destroy (struct clock *clock);
+
+/*
+ * CLOCK-Pro (Jiang, Chen, Zhang, USENIX 2005). resident pages are hot or
+ * cold, cold pages get a test period during which they are remembered
+ * after eviction. a reuse within the test period makes the page hot and
+ * grows the cold target, a test period running out shrinks it. hits only
+ * set the reference bit, the three hands do the rest on misses.
+ */
+#define CLOCKPRO_HOT	0x1
+#define CLOCKPRO_RESIDENT	0x2
+#define CLOCKPRO_TEST	0x4
+#define CLOCKPRO_REF	0x8
+
+struct clockpro_ele {
+	uint64 key;
+	uint32 next;
+	uint32 prev;
+	uint32 flags;
+};
+
+struct clockpro {
+	struct clockpro_ele *eles;
+	uint32 size;
+	uint32 nused;
+	uint32 free;
+	/* non resident pages still in their test period, key -> ele */
+	struct hash_table *ghosts;
+	uint32 max_elements;
+	uint32 nhot;
+	uint32 ncold;
+	uint32 nnonres;
+	uint32 cold_target;
+	uint32 hand_hot;
+	uint32 hand_cold;
+	uint32 hand_test;
+};
+
+struct clockpro * clockpro_init (uint32 max_elements);
+struct clockpro_ele* clockpro_insert (struct clockpro *cp, uint64 key, uint64 *removed_key);
+uint32 clockpro_bump (struct clockpro *cp, struct clockpro_ele *ele);
+uint32 clockpro_num_elements (struct clockpro *cp);
+uint64 clockpro_memory (struct clockpro *cp);
+void clockpro_destroy (struct clockpro *cp);
+
+#endif
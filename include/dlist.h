@@ -0,0 +1,60 @@
+#ifndef _DLIST_H_
+#define _DLIST_H_
+#include "types.h"
+
+/*
+ * intrusive doubly linked list, the node is embedded in the caller's
+ * element. head is the most recent end, tail the oldest.
+ */
+struct dlist_node {
+	struct dlist_node *next;
+	struct dlist_node *prev;
+};
+
+struct dlist {
+	struct dlist_node *head;
+	struct dlist_node *tail;
+	uint32 n;
+};
+
+#define dlist_entry(node, type, member) \
+	((type *)((char *)(node) - __builtin_offsetof(type, member)))
+
+static inline void dlist_push_head(struct dlist *list, struct dlist_node *node)
+{
+	node->prev = NULL;
+	node->next = list->head;
+	if (list->head) {
+		list->head->prev = node;
+	} else {
+		list->tail = node;
+	}
+	list->head = node;
+	list->n++;
+}
+
+static inline void dlist_remove(struct dlist *list, struct dlist_node *node)
+{
+	if (node->prev) {
+		node->prev->next = node->next;
+	} else {
+		list->head = node->next;
+	}
+	if (node->next) {
+		node->next->prev = node->prev;
+	} else {
+		list->tail = node->prev;
+	}
+	node->next = node->prev = NULL;
+	list->n--;
+}
+
+static inline void dlist_move_head(struct dlist *list, struct dlist_node *node)
+{
+	if (list->head != node) {
+		dlist_remove(list, node);
+		dlist_push_head(list, node);
+	}
+}
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef _EXTENT_H_
+#define _EXTENT_H_
+#include "types.h"
+#include "hash.h"
+#include "lru.h"
+#include "pool.h"
+
+/*
+ * lru cache index over runs of contiguous blocks.
+ *
+ * an extent is a run of blocks that were touched in address order by a
+ * single request, so they are also in lru order and can share one lru
+ * element. extents are split when part of them is hit and trimmed from
+ * the low end on eviction, which gives the same hits and misses as one
+ * entry per block.
+ *
+ * extents never cross a chunk of chunk_blocks blocks, the hash table is
+ * keyed by chunk and holds the sorted extents of the chunk.
+ */
+struct extent {
+	uint64 start;
+	uint32 len;
+	struct extent *next;
+	struct lru_ele *ele;
+};
+
+struct extent_chunk {
+	struct extent *first;
+};
+
+struct extent_index {
+	struct hash_table *chunks;
+	struct lru *lru;
+	struct pool *extent_pool;
+	struct pool *chunk_pool;
+	uint64 max_blocks;
+	uint64 nblocks;
+	uint32 chunk_blocks;
+};
+
+struct extent_index * extent_init (uint64 max_blocks, uint32 chunk_blocks);
+void extent_access (struct extent_index *idx, uint64 start, uint64 nblks, uint64 *hits, uint64 *misses);
+uint64 extent_num_blocks (struct extent_index *idx);
+uint32 extent_num_extents (struct extent_index *idx);
+void extent_destroy (struct extent_index *idx);
+
+#endif
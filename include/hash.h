@@ -1,11 +1,24 @@
 #ifndef _HASH_H_
 #define _HASH_H_
+#include <stdio.h>
 #include "types.h"
+#include "pool.h"
+
+/* hash_init flags: table layout */
+#define HASH_CHAINED	0x0
+#define HASH_OPEN	0x1
+#define HASH_TYPE_MASK	0xF
+/* keep a dense array of the elements for O(1) hash_get_nth */
+#define HASH_SAMPLE	0x10
+
+/* keys resolved per round of hash_lookup_batch */
+#define HASH_BATCH	(16)
 
 struct hash {
 	uint64 key;
 	struct hash * next;
 	void *data;
+	uint32 idx;
 };
 
 struct hash_table_entries {
@@ -13,18 +26,84 @@ struct hash_table_entries {
 	struct hash * next;
 };
 
+/*
+ * open addressing slot, robin hood probing.
+ * dist is the probe distance + 1, 0 means the slot is empty.
+ * HASH_SLOT_DELETED marks entries removed from a table being drained.
+ */
+#define HASH_SLOT_DELETED	0x80000000
+struct hash_slot {
+	uint64 key;
+	void *data;
+	uint32 dist;
+	uint32 idx;
+};
+
+/* HASH_SAMPLE: idx in the slot or chain node is the position here */
+struct hash_dense {
+	uint64 key;
+	void *data;
+};
+
+/*
+ * probe counts kept by lookups and deletes, a probe is one chain node or
+ * one slot looked at. the last histogram bin holds everything longer.
+ */
+#define HASH_STATS_HIST	(16)
+struct hash_stats {
+	uint64 ops;
+	uint64 probes;
+	uint64 probe_hist[HASH_STATS_HIST];
+	uint32 max_probe;
+	uint32 grows;
+	uint32 shrinks;
+	uint64 rehashed;
+};
+
 struct hash_table {
 	uint32 num_tables;
 	uint64 (*hash_func)(struct hash_table*, uint64 key);
 	struct hash_table_entries *table;
 	uint32 nelements;
+	uint32 flags;
+	struct hash_slot *slots;
+	struct pool *pool;
+	/*
+	 * incremental resize: the old table is drained into the current
+	 * one a few buckets per insert/delete, starting at rehash_idx.
+	 */
+	uint32 min_tables;
+	uint32 old_num_tables;
+	struct hash_table_entries *old_table;
+	struct hash_slot *old_slots;
+	uint32 rehash_idx;
+	/* optional, hashes a whole batch of keys for hash_lookup_batch */
+	void (*hash_batch)(uint64 *keys, uint32 n, uint64 *out);
+	struct hash_stats stats;
+	struct hash_dense *dense;
+	uint32 ndense;
+	uint32 dense_size;
 };
 
-struct hash_table *hash_init(uint32 buckets, uint64 (*hash_func)(struct hash_table*table, uint64 key));
+/*
+ * hash_func returns a 64 bit hash of the key, the table masks it down to
+ * its current (power of two) size. buckets is only the initial size, the
+ * table grows and shrinks with the number of elements.
+ */
+
+struct hash_table *hash_init(uint32 buckets, uint32 flags, uint64 (*hash_func)(struct hash_table*table, uint64 key));
 uint32 hash_insert(struct hash_table* table, uint64 key, void* data);
 uint32 hash_lookup(struct hash_table* table, uint64 key, void ** data);
+uint32 hash_lookup_batch(struct hash_table* table, uint64 *keys, uint32 n, void ** data);
+uint32 hash_lookup_batch_hashed(struct hash_table* table, uint64 *keys, uint64 *hashes, uint32 n, void ** data);
 uint32 hash_delete (struct hash_table*table,uint64 key, void ** data);
+uint32 hash_delete_batch(struct hash_table* table, uint64 *keys, uint32 n);
 uint32 hash_num_elements (struct hash_table*table);
 uint32 hash_num_elements_bucket(struct hash_table*table, uint32 bucket);
+void hash_destroy(struct hash_table *table);
+uint32 hash_get_nth(struct hash_table *table, uint32 n, uint64 *key, void ** data);
+uint64 hash_memory(struct hash_table *table);
+void hash_rehash_finish(struct hash_table *table);
+void hash_stats_dump_json(struct hash_table *table, FILE *fp);
 
 #endif
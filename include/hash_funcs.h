@@ -0,0 +1,28 @@
+#ifndef _HASH_FUNCS_H_
+#define _HASH_FUNCS_H_
+#include <stdio.h>
+#include "types.h"
+#include "hash.h"
+
+/*
+ * built in hash functions for hash_init. batch hashes n keys into out,
+ * it is the AVX2 version when the cpu has it.
+ */
+struct hash_func_desc {
+	const char *name;
+	uint64 (*func)(struct hash_table *table, uint64 key);
+	void (*batch)(uint64 *keys, uint32 n, uint64 *out);
+};
+
+extern struct hash_func_desc hash_funcs[];
+
+struct hash_func_desc * hash_func_find(const char *name);
+void hash_func_list(FILE *fp);
+
+uint64 hash_identity(struct hash_table *table, uint64 key);
+uint64 hash_fib(struct hash_table *table, uint64 key);
+uint64 hash_murmur(struct hash_table *table, uint64 key);
+uint64 hash_xxh64(struct hash_table *table, uint64 key);
+uint64 hash_wy(struct hash_table *table, uint64 key);
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef _LIRS_H_
+#define _LIRS_H_
+#include "types.h"
+#include "dlist.h"
+#include "hash.h"
+#include "pool.h"
+#include "lru.h"
+
+/*
+ * LIRS (Jiang, Zhang, SIGMETRICS 2002). blocks are ranked by reuse
+ * distance instead of recency: lir blocks have a short one and fill all
+ * but 1% of the cache, hir blocks sit in the small queue q and are the
+ * only ones evicted. the stack s orders lir blocks and recently seen hir
+ * blocks, an hir block reused while still on s becomes lir.
+ * non resident hir blocks stay on s, at most max_elements of them.
+ */
+#define LIRS_LIR	0x1
+#define LIRS_RESIDENT	0x2
+#define LIRS_IN_S	0x4
+
+struct lirs_ele {
+	struct dlist_node s;
+	/* on q while resident hir, on the ghost fifo while non resident */
+	struct dlist_node q;
+	uint64 key;
+	uint32 flags;
+};
+
+struct lirs {
+	struct dlist s;
+	struct dlist q;
+	struct dlist ghost_fifo;
+	/* non resident keys still on s -> ele */
+	struct hash_table *ghosts;
+	struct pool *pool;
+	uint32 max_elements;
+	uint32 lir_max;
+	uint32 nlir;
+};
+
+struct lirs * lirs_init (uint32 max_elements);
+struct lirs_ele* lirs_insert (struct lirs *lirs, uint64 key, uint64 *removed_key);
+uint32 lirs_bump (struct lirs *lirs, struct lirs_ele *ele);
+uint32 lirs_num_elements (struct lirs *lirs);
+uint64 lirs_memory (struct lirs *lirs);
+void lirs_destroy (struct lirs *lirs);
+
+#endif
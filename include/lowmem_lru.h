@@ -1,6 +1,8 @@
 #ifndef _LRU_LOWMEM_H_
 #define _LRU_LOWMEM_H_
 #include "types.h"
+#include "hash.h"
+#include "packed_hash.h"
 #define INVALID_KEY 0xFFFFFFFFFFFFFFFF
 #if 0
 struct lowmemlru_ele {
@@ -9,11 +11,22 @@ struct lowmemlru_ele {
 	struct lowmemlru_ele *prev;
 };
 #endif
-struct tagTable {
-	uint32 tagTable;
-	uint32 tagIOCount;
-	struct tagTable * next;
-};
+/*
+ * blocks are stamped with globalTag, which moves on every bumpupCounter
+ * I/Os. tagRing counts the blocks of each live tag, indexed by the tag
+ * number itself: the live tags are lowmemlruMaxTag..globalTag and the
+ * oldest slot also counts every block with an older tag. that oldest
+ * group is kept at lowmemblks blocks or more and its blocks are the
+ * eviction candidates.
+ *
+ * blocks are indexed either by a HASH_SAMPLE hash table of elements or,
+ * with LOWMEM_PACKED, by a packed_table holding the block and the low 16
+ * bits of its tag in 8 bytes.
+ */
+#define LOWMEM_PACKED	0x100
+#define PACKED_TAGS	(1 << 16)
+#define LOWMEM_SAMPLES	(5)
+#define LOWMEM_SEED	(1)
 
 struct lowmemlru {
 	uint32 lowmemblks;
@@ -23,18 +36,33 @@ struct lowmemlru {
 	uint32 lowmemlruMaxTag;
 	uint32 blocksPresent;
 	uint32 cacheSize;
-	struct tagTable *latestEntry;
-	struct tagTable *tagTable;
+	/* power of two, fixed at lowmemlru_init */
+	uint32 tagRingSize;
+	uint32 *tagRing;
+	/* eviction looks at this many random blocks and takes the oldest */
+	uint32 samples;
+	uint64 seed;
+	struct hash_table *table;
+	struct packed_table *packed;
 };
 
 struct lowmemlru_ele {
 	uint64 key;
 	uint32 blockTag;
 };
-struct lowmemlru * lru_init (uint32 lruPct, uint32 maxBlks);
-struct lowmemlru_ele* lru_insert (struct lowmemlru *lru, uint64 key, uint64 *removed_key);
-uint32 lru_bump (struct lowmemlru * lru, struct lowmemlru_ele * ele);
 
+/* flags are the hash_init table type or LOWMEM_PACKED */
+struct lowmemlru * lowmemlru_init (uint32 lruPct, uint32 maxBlks, uint32 flags,
+		uint64 (*hash_func)(struct hash_table*table, uint64 key));
+void lowmemlru_set_sampling (struct lowmemlru *lru, uint32 samples, uint64 seed);
+/* hash mode, the caller keeps lru->table in step with these */
+struct lowmemlru_ele* lowmemlru_insert (struct lowmemlru *lru, uint64 key, uint64 *removed_key);
+uint32 lowmemlru_bump (struct lowmemlru * lru, struct lowmemlru_ele * ele);
+/* either mode, looks the block up and inserts it on a miss, SUCCESS on a hit */
+uint32 lowmemlru_access (struct lowmemlru *lru, uint64 key);
+uint32 lowmemlru_num_elements (struct lowmemlru *lru);
+/* everything kept for the blocks, element allocations included */
+uint64 lowmemlru_memory (struct lowmemlru *lru);
+void lowmemlru_destroy (struct lowmemlru *lru);
 
-	
 #endif
@@ -1,6 +1,7 @@
 #ifndef _LRU_H_
 #define _LRU_H_
 #include "types.h"
+#include "pool.h"
 #define INVALID_KEY 0xFFFFFFFFFFFFFFFF
 struct lru_ele {
 	uint64 key;
@@ -8,15 +9,65 @@ struct lru_ele {
 	struct lru_ele *prev;
 };
 
+/* lru_init_flags flags */
+#define LRU_INTRUSIVE	0x1
+
+/*
+ * LRU_INTRUSIVE: one preallocated slot per block, the list and the hash
+ * chain are 32 bit slot indices and the lru indexes keys itself through
+ * lru_lookup, no separate hash table is needed. the lru_ele pointers
+ * handed out in this mode point at slots and are only good for passing
+ * back to lru_bump/lru_remove/lru_insert_after.
+ */
+#define LRU_NIL	0xFFFFFFFF
+struct lru_slot {
+	uint64 key;
+	uint32 next;
+	uint32 prev;
+	uint32 hnext;
+	/* *clock when last linked at the head, if the lru has a clock */
+	uint32 stamp;
+};
+
 struct lru {
 	struct lru_ele *head;
 	struct lru_ele *tail;
 	uint32 max_elements;
 	uint32 nelements;
+	struct pool *pool;
+	uint32 flags;
+	struct lru_slot *slots;
+	uint32 *buckets;
+	uint32 bucket_bits;
+	uint32 ihead;
+	uint32 itail;
+	uint32 nused;
+	uint32 free;
+	uint32 slot_cap;
+	/* optional shared clock for the slot stamps */
+	uint32 *clock;
+	/* lru_insert_batch evicts down to this once past max_elements */
+	uint32 low_mark;
 };
 
 
 struct lru * lru_init (uint32 max_elements);
+struct lru * lru_init_flags (uint32 max_elements, uint32 flags);
+struct lru_ele* lru_lookup (struct lru *lru, uint64 key);
+/*
+ * inserts n missed keys as n lru_insert calls would, eles[i] is NULL for
+ * keys evicted again within the batch. evicted keys go to removed, which
+ * needs room for n + max_elements - low_mark keys. returns their number.
+ */
+uint32 lru_insert_batch (struct lru *lru, uint64 *keys, uint32 n, struct lru_ele **eles, uint64 *removed);
+uint32 lru_evict (struct lru *lru, uint32 n, uint64 *removed);
+void lru_set_low_watermark (struct lru *lru, uint32 low_mark);
+uint32 lru_resize (struct lru *lru, uint32 max_elements, uint64 *removed);
+uint32 lru_tail_stamp (struct lru *lru);
 struct lru_ele* lru_insert (struct lru *lru, uint64 key, uint64 *removed_key);
 uint32 lru_bump (struct lru * lru, struct lru_ele * ele);
+struct lru_ele* lru_insert_after (struct lru *lru, struct lru_ele *pos, uint64 key);
+uint32 lru_remove (struct lru *lru, struct lru_ele *ele);
+uint64 lru_memory (struct lru *lru);
+void lru_destroy (struct lru *lru);
 #endif
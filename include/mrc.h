@@ -0,0 +1,75 @@
+#ifndef _MRC_H_
+#define _MRC_H_
+#include "types.h"
+#include "hash.h"
+
+/*
+ * Mattson stack distances in one pass. every block's last access time
+ * sits in a treap ordered by time with subtree sizes, the stack distance
+ * of an access is one more than the number of blocks touched since the
+ * block's previous access. an lru of C blocks hits exactly the accesses
+ * with distance <= C, so the distance histogram gives the hits of every
+ * cache size at once.
+ *
+ * SHARDS (Waldspurger et al., FAST 2015): with sampling on only blocks
+ * whose spatial hash is below threshold are tracked, a rate R of them,
+ * and their distances scaled by 1/R. with max_samples set the threshold
+ * is lowered whenever more blocks than that are tracked, dropping the
+ * ones with the highest hash, so memory stays fixed. the histogram is
+ * kept divided by scale, which lowering the threshold shrinks, so older
+ * counts are rescaled to the new rate without touching them.
+ */
+#define MRC_HASH_BITS	(24)
+#define MRC_HASH_SPACE	(1U << MRC_HASH_BITS)
+
+struct mrc_node {
+	uint64 time;
+	uint32 left;
+	uint32 right;
+	uint32 prio;
+	uint32 size;
+};
+
+/* max heap entry of the tracked blocks by hash, for max_samples */
+struct mrc_sample {
+	uint64 key;
+	uint32 hash;
+};
+
+struct mrc {
+	/* block -> its treap node, which is reused on every access */
+	struct hash_table *last;
+	struct mrc_node *nodes;
+	uint32 nnodes;
+	uint32 nused;
+	uint32 free;
+	uint32 root;
+	uint64 now;
+	uint64 seed;
+	/* hist[d] accesses at (scaled) distance d, all times scale */
+	double *hist;
+	uint64 hist_size;
+	double cold;
+	double sampled;
+	double scale;
+	uint64 accesses;
+	/* tracked blocks hash below threshold, MRC_HASH_SPACE tracks all */
+	uint32 threshold;
+	uint32 max_samples;
+	struct mrc_sample *heap;
+	uint32 nheap;
+};
+
+struct mrc * mrc_init (void);
+/* rate in (0, 1], max_samples 0 keeps the rate fixed */
+uint32 mrc_set_sampling (struct mrc *mrc, double rate, uint32 max_samples);
+/* returns the (scaled) stack distance, 0 for a first or untracked access */
+uint64 mrc_access (struct mrc *mrc, uint64 key);
+/* hits of an lru of each of the n sizes, which must be ascending */
+void mrc_hits (struct mrc *mrc, uint64 *sizes, uint32 n, uint64 *hits);
+/* distinct blocks seen, estimated when sampling */
+uint64 mrc_blocks (struct mrc *mrc);
+uint64 mrc_memory (struct mrc *mrc);
+void mrc_destroy (struct mrc *mrc);
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef _PACKED_HASH_H_
+#define _PACKED_HASH_H_
+#include "types.h"
+
+/*
+ * fixed size open addressing table of 8 byte slots: a 48 bit key and a
+ * 16 bit value packed together, no separate element or pointer. linear
+ * probing with backward shift deletes. it does not grow, size it for the
+ * most elements it will hold.
+ */
+#define PACKED_KEY_BITS	(48)
+#define PACKED_KEY_MASK	((1ULL << PACKED_KEY_BITS) - 1)
+#define PACKED_EMPTY	(~0ULL)
+#define PACKED_KEY(slot)	((slot) & PACKED_KEY_MASK)
+#define PACKED_VAL(slot)	((uint32)((slot) >> PACKED_KEY_BITS))
+
+struct packed_table {
+	uint64 *slots;
+	uint32 size;
+	uint32 nelements;
+};
+
+/* room for max_elements at no more than 3/4 full */
+struct packed_table *packed_init(uint32 max_elements);
+/* returns the slot index of key or PACKED_NONE */
+#define PACKED_NONE	0xFFFFFFFF
+uint32 packed_lookup(struct packed_table *pt, uint64 key);
+uint32 packed_insert(struct packed_table *pt, uint64 key, uint32 val);
+void packed_set_val(struct packed_table *pt, uint32 slot, uint32 val);
+void packed_delete(struct packed_table *pt, uint32 slot);
+/* a random occupied slot, uniform over the elements, seed is the caller's prng state */
+uint32 packed_sample(struct packed_table *pt, uint64 *seed);
+uint64 packed_memory(struct packed_table *pt);
+void packed_destroy(struct packed_table *pt);
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef _POLICY_H_
+#define _POLICY_H_
+#include <stdio.h>
+#include "types.h"
+
+/*
+ * replacement policies behind one interface. insert adds a key that
+ * missed and returns its element, evicting at most one resident key into
+ * removed_key (INVALID_KEY if none). bump is called with that element on
+ * every hit.
+ */
+struct policy {
+	const char *name;
+	void * (*init)(uint32 max_elements);
+	void * (*insert)(void *cache, uint64 key, uint64 *removed_key);
+	uint32 (*bump)(void *cache, void *ele);
+	uint32 (*num_elements)(void *cache);
+	uint64 (*memory)(void *cache);
+	void (*destroy)(void *cache);
+};
+
+extern struct policy policies[];
+
+struct policy * policy_find(const char *name);
+void policy_list(FILE *fp);
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef _POOL_H_
+#define _POOL_H_
+#include <stdio.h>
+#include "types.h"
+
+/*
+ * fixed size object pool. objects are carved out of large slabs and
+ * recycled through a free list, slabs are only released by pool_destroy.
+ */
+struct pool_slab {
+	struct pool_slab *next;
+};
+
+struct pool {
+	uint32 elem_size;
+	uint32 elems_per_slab;
+	void *free_list;
+	struct pool_slab *slabs;
+	char *next_free;
+	uint32 slab_left;
+	/* stats */
+	uint64 nslabs;
+	uint64 nallocs;
+	uint64 nfrees;
+	uint64 in_use;
+	uint64 peak;
+};
+
+struct pool * pool_init(uint32 elem_size, uint32 elems_per_slab);
+void * pool_alloc(struct pool *pool);
+void pool_free(struct pool *pool, void *ptr);
+void pool_destroy(struct pool *pool);
+uint64 pool_bytes(struct pool *pool);
+void pool_print_stats(struct pool *pool, const char *name, FILE *fp);
+
+#endif
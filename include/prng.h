@@ -0,0 +1,18 @@
+#ifndef _PRNG_H_
+#define _PRNG_H_
+#include "types.h"
+
+/*
+ * xorshift64*: a 64 bit state per user, cheap enough for eviction
+ * sampling and treap priorities. the state must not be zero, it would
+ * stay zero. the high bits are the good ones.
+ */
+static inline uint64 prng_next(uint64 *seed)
+{
+	*seed ^= *seed >> 12;
+	*seed ^= *seed << 25;
+	*seed ^= *seed >> 27;
+	return *seed * 0x2545f4914f6cdd1dULL;
+}
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef _S3FIFO_H_
+#define _S3FIFO_H_
+#include "types.h"
+#include "dlist.h"
+#include "hash.h"
+#include "pool.h"
+#include "lru.h"
+
+/*
+ * S3-FIFO (Yang et al., SOSP 2023). new blocks enter the small fifo
+ * (10% of the cache), the ones hit more than once by the time they reach
+ * its tail move on to the main fifo, the rest are evicted and their keys
+ * kept on the ghost fifo. a miss on a ghost key goes straight to main.
+ * main reinserts blocks with a non zero freq, decrementing it.
+ * s3fifo_bump only does a relaxed load and store of the 2 bit freq, it
+ * may run concurrently with other bumps, insert needs the caller's lock.
+ */
+#define S3FIFO_SMALL	0
+#define S3FIFO_MAIN	1
+#define S3FIFO_GHOST	2
+#define S3FIFO_FREQ_MAX	3
+
+struct s3fifo_ele {
+	struct dlist_node node;
+	uint64 key;
+	uint32 list;
+	uint32 freq;
+};
+
+struct s3fifo {
+	struct dlist lists[3];
+	/* keys on the ghost fifo -> ele */
+	struct hash_table *ghosts;
+	struct pool *pool;
+	uint32 max_elements;
+	uint32 small_max;
+};
+
+struct s3fifo * s3fifo_init (uint32 max_elements);
+struct s3fifo_ele* s3fifo_insert (struct s3fifo *s3, uint64 key, uint64 *removed_key);
+uint32 s3fifo_bump (struct s3fifo *s3, struct s3fifo_ele *ele);
+uint32 s3fifo_num_elements (struct s3fifo *s3);
+uint64 s3fifo_memory (struct s3fifo *s3);
+void s3fifo_destroy (struct s3fifo *s3);
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef _SHARD_HASH_H_
+#define _SHARD_HASH_H_
+#include <pthread.h>
+#include "types.h"
+#include "hash.h"
+
+/*
+ * thread safe hash table made of independent hash_tables, each behind
+ * its own lock. a key always maps to the same shard, so the per shard
+ * tables keep the hash.h semantics and their counters are summed on read.
+ */
+#define SHARD_CACHELINE	(64)
+
+struct hash_shard {
+	pthread_mutex_t lock;
+	struct hash_table *table;
+} __attribute__((aligned(SHARD_CACHELINE)));
+
+struct shard_hash {
+	uint32 nshards;
+	uint64 (*hash_func)(struct hash_table*, uint64 key);
+	struct hash_shard *shards;
+};
+
+/*
+ * hash_func is also used to pick the shard and is called with a NULL
+ * table for that, it must only depend on the key.
+ */
+struct shard_hash *shard_hash_init(uint32 nshards, uint32 buckets, uint32 flags, uint64 (*hash_func)(struct hash_table*table, uint64 key));
+uint32 shard_hash_insert(struct shard_hash *sh, uint64 key, void *data);
+uint32 shard_hash_lookup(struct shard_hash *sh, uint64 key, void **data);
+uint32 shard_hash_delete(struct shard_hash *sh, uint64 key, void **data);
+uint64 shard_hash_num_elements(struct shard_hash *sh);
+void shard_hash_destroy(struct shard_hash *sh);
+
+#endif
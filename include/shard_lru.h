@@ -0,0 +1,43 @@
+#ifndef _SHARD_LRU_H_
+#define _SHARD_LRU_H_
+#include <pthread.h>
+#include "types.h"
+#include "lru.h"
+
+/*
+ * thread safe cache made of independent intrusive lrus, each behind its
+ * own lock. a key always maps to the same shard, the capacity is split
+ * evenly between them.
+ *
+ * every shard stamps its blocks with a shared clock that advances once
+ * every SHARD_LRU_TICK accesses of a shard, so the tail stamps of two
+ * shards tell which one is evicting older data. shard_lru_rebalance
+ * moves capacity from the shard with the oldest tail to the one with
+ * the youngest, which brings the shards closer to one global lru.
+ */
+#define SHARD_LRU_CACHELINE	(64)
+#define SHARD_LRU_TICK	(256)
+
+struct lru_shard {
+	pthread_mutex_t lock;
+	struct lru *lru;
+	uint32 ticks;
+	uint64 hits;
+	uint64 misses;
+} __attribute__((aligned(SHARD_LRU_CACHELINE)));
+
+struct shard_lru {
+	uint32 nshards;
+	uint32 clock;
+	struct lru_shard *shards;
+};
+
+struct shard_lru *shard_lru_init(uint32 nshards, uint32 max_elements);
+/* SUCCESS on a hit, a miss inserts key and may evict into removed_key */
+uint32 shard_lru_access(struct shard_lru *sl, uint64 key, uint64 *removed_key);
+uint32 shard_lru_rebalance(struct shard_lru *sl, uint32 step);
+uint64 shard_lru_num_elements(struct shard_lru *sl);
+void shard_lru_stats(struct shard_lru *sl, uint64 *hits, uint64 *misses);
+void shard_lru_destroy(struct shard_lru *sl);
+
+#endif
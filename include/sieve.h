@@ -0,0 +1,36 @@
+#ifndef _SIEVE_H_
+#define _SIEVE_H_
+#include "types.h"
+#include "dlist.h"
+#include "pool.h"
+#include "lru.h"
+
+/*
+ * SIEVE (Zhang et al., NSDI 2024). one fifo, new blocks go in at the
+ * head and a hit only sets visited. the hand walks from the tail towards
+ * the head clearing visited bits and evicts the first unvisited block,
+ * survivors stay where they are.
+ * sieve_bump is a single relaxed atomic store and may run concurrently
+ * with other bumps, insert needs the caller's lock.
+ */
+struct sieve_ele {
+	struct dlist_node node;
+	uint64 key;
+	uint32 visited;
+};
+
+struct sieve {
+	struct dlist fifo;
+	struct dlist_node *hand;
+	struct pool *pool;
+	uint32 max_elements;
+};
+
+struct sieve * sieve_init (uint32 max_elements);
+struct sieve_ele* sieve_insert (struct sieve *sieve, uint64 key, uint64 *removed_key);
+uint32 sieve_bump (struct sieve *sieve, struct sieve_ele *ele);
+uint32 sieve_num_elements (struct sieve *sieve);
+uint64 sieve_memory (struct sieve *sieve);
+void sieve_destroy (struct sieve *sieve);
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef _SPSC_H_
+#define _SPSC_H_
+#include "types.h"
+
+/*
+ * single producer single consumer ring of pointers without locks: only
+ * the producer moves tail and only the consumer moves head, each on its
+ * own cache line. push fails when full and pop when empty, the caller
+ * decides how to wait.
+ */
+#define SPSC_SIZE	(16)
+
+struct spsc_ring {
+	uint32 head __attribute__((aligned(64)));
+	uint32 tail __attribute__((aligned(64)));
+	void *slots[SPSC_SIZE] __attribute__((aligned(64)));
+};
+
+static inline uint32 spsc_push(struct spsc_ring *ring, void *p)
+{
+	uint32 tail = ring->tail;
+
+	if (tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == SPSC_SIZE) {
+		return FAILURE;
+	}
+	ring->slots[tail & (SPSC_SIZE - 1)] = p;
+	__atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+	return SUCCESS;
+}
+
+static inline uint32 spsc_pop(struct spsc_ring *ring, void **p)
+{
+	uint32 head = ring->head;
+
+	if (head == __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)) {
+		return FAILURE;
+	}
+	*p = ring->slots[head & (SPSC_SIZE - 1)];
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+	return SUCCESS;
+}
+
+#endif
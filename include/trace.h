@@ -0,0 +1,113 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+#include <stdio.h>
+#include <pthread.h>
+#include "types.h"
+
+/*
+ * spc trace reader: the device size on the first line, then one
+ * <offset> <len in bytes> <R/W> record per line. a regular file is
+ * mmapped and parsed in place, anything else (a pipe) is read in
+ * TRACE_BUF_SIZE chunks. records come out in batches.
+ *
+ * a trace starting with TRACE_BIN_MAGIC is the binary form, read the
+ * same way: a 16 byte header (magic, version, flags, 2 bytes padding,
+ * the device size as 8 little endian bytes) and then per record
+ *	varint: zigzag(start - previous start) << 1 | write
+ *	varint: len/512 << 1, or len << 1 | 1 if not a multiple of 512
+ *	varint: time - previous time, with TRACE_BIN_TIME only
+ * varints are 7 bits a byte, low bits first, the top bit set on all but
+ * the last byte. a 4K random read is typically 5 or 6 bytes.
+ *
+ * either form may be gzip or (built with ZSTD=1) zstd compressed, also
+ * told apart by the magic. a compressed trace is decompressed and parsed
+ * on its own thread, which hands batches over through a queue of
+ * TRACE_QUEUE of them.
+ */
+#define TRACE_BIN_MAGIC	"SPCB"
+#define TRACE_BIN_VERSION	(1)
+#define TRACE_BIN_HDR	(16)
+#define TRACE_BIN_TIME	0x1
+/* longest encoded record, three 10 byte varints */
+#define TRACE_BIN_MAXREC	(30)
+#define TRACE_QUEUE	(8)
+#define TRACE_GZIP	1
+#define TRACE_ZSTD	2
+#define TRACE_BATCH	(1024)
+#define TRACE_BUF_SIZE	(1 << 20)
+
+struct trace_rec {
+	uint64 start;
+	uint64 len;
+	/* binary traces with TRACE_BIN_TIME only, else 0 */
+	uint64 time;
+	char rw;
+};
+
+struct trace {
+	int fd;
+	/* mmapped file, or NULL when reading into buf */
+	char *map;
+	uint64 map_len;
+	char *buf;
+	/* unparsed bytes are pos..end, only whole lines up to limit */
+	char *pos;
+	char *limit;
+	char *end;
+	int eof;
+	uint64 records;
+	/* binary trace state */
+	int binary;
+	uint32 flags;
+	uint64 prev_start;
+	uint64 prev_time;
+	/* compressed traces: raw input zin_pos..zin_end and the decompressor */
+	int zip;
+	void *zstream;
+	char *zin;
+	char *zin_pos;
+	char *zin_end;
+	int zin_eof;
+	/* the decompressing thread and its batches */
+	uint64 size;
+	uint32 size_ok;
+	int started;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t not_empty;
+	pthread_cond_t not_full;
+	struct trace_batch *queue;
+	uint32 qhead;
+	uint32 qtail;
+	/* records of the head batch already handed out */
+	uint32 qoff;
+	int done;
+	int stop;
+};
+
+struct trace_batch {
+	struct trace_rec recs[TRACE_BATCH];
+	uint32 n;
+};
+
+struct trace_writer {
+	FILE *fp;
+	uint32 flags;
+	uint64 prev_start;
+	uint64 prev_time;
+	uint64 bytes;
+};
+
+/* path NULL or "-" reads stdin */
+struct trace * trace_open (const char *path);
+uint32 trace_read_size (struct trace *trace, uint64 *size);
+/* fills up to max records, 0 at the end of the trace */
+uint32 trace_next_batch (struct trace *trace, struct trace_rec *recs, uint32 max);
+void trace_close (struct trace *trace);
+
+/* binary traces, flags 0 or TRACE_BIN_TIME */
+struct trace_writer * trace_writer_open (FILE *fp, uint64 size, uint32 flags);
+uint32 trace_write (struct trace_writer *tw, struct trace_rec *rec);
+uint32 trace_writer_close (struct trace_writer *tw);
+
+#endif
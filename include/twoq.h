@@ -0,0 +1,43 @@
+#ifndef _TWOQ_H_
+#define _TWOQ_H_
+#include "types.h"
+#include "dlist.h"
+#include "hash.h"
+#include "pool.h"
+#include "lru.h"
+
+/*
+ * full 2Q (Johnson, Shasha, VLDB 1994). new blocks go to the a1in fifo,
+ * the keys it evicts are remembered on a1out. only a miss on a key still
+ * on a1out gets the block into the am lru, so a scan passes through
+ * a1in without touching am.
+ */
+#define TWOQ_A1IN	0
+#define TWOQ_AM	1
+#define TWOQ_A1OUT	2
+
+struct twoq_ele {
+	struct dlist_node node;
+	uint64 key;
+	uint32 list;
+};
+
+struct twoq {
+	struct dlist lists[3];
+	/* keys on a1out -> ele */
+	struct hash_table *ghosts;
+	struct pool *pool;
+	uint32 max_elements;
+	/* a1in and a1out sizes, 25% and 50% of the cache */
+	uint32 kin;
+	uint32 kout;
+};
+
+struct twoq * twoq_init (uint32 max_elements);
+struct twoq_ele* twoq_insert (struct twoq *q, uint64 key, uint64 *removed_key);
+uint32 twoq_bump (struct twoq *q, struct twoq_ele *ele);
+uint32 twoq_num_elements (struct twoq *q);
+uint64 twoq_memory (struct twoq *q);
+void twoq_destroy (struct twoq *q);
+
+#endif
@@ -3,222 +3,354 @@
 #include <strings.h>
 
 #include "types.h"
+#include "trace.h"
 #include "hash.h"
+#include "hash_funcs.h"
+#include "lru.h"
 #include "lowmem_lru.h"
 #include <string.h>
-#define NUM_BUCKETS	(10000000)
+#include <time.h>
+#include <unistd.h>
+#define NUM_BUCKETS	(1024)
 #define BLOCK_SIZE (512)
+#define SWEEP_MAX	(16)
 uint64 size = 0;
 uint64 lru_blocks = 0;
+uint64 cache_bs = BLOCK_SIZE;
 
 struct hash_table* table = NULL;
 struct lowmemlru * lru = NULL;
 uint64 hits = 0, misses = 0;
-uint64 hash_func (struct hash_table*table, uint64 key) 
-{
-	return key % table->num_tables;
-}
+/* stdin through the trace reader, a batch at a time */
+struct trace *trace = NULL;
+struct trace_rec recs[TRACE_BATCH];
+uint32 nrecs = 0, next_rec = 0;
 
 void get_size ()
 {
-	scanf("%lld\n",&size);
+	trace = trace_open(NULL);
+	if (!trace || !trace_read_size(trace, &size)) {
+		printf("Cannot read the trace\n");
+		exit(-1);
+	}
 }
 
 int read_spc_trace(uint64 *start, uint64 *len, char *rw)
 {
-	return scanf("%lld %lld %c",start,len,rw);
+	if (next_rec == nrecs) {
+		nrecs = trace_next_batch(trace, recs, TRACE_BATCH);
+		next_rec = 0;
+		if (nrecs == 0) {
+			return EOF;
+		}
+	}
+	*start = recs[next_rec].start;
+	*len = recs[next_rec].len;
+	*rw = recs[next_rec].rw;
+	next_rec++;
+	return 3;
 }
-int main(int argc, char **argv) 
+/*
+ * cache blocks covered by a request, start is in 512 byte sectors.
+ */
+uint64 request_blocks(uint64 start, uint64 len, uint64 *first)
 {
-	uint64 start_blk = 0;
-	uint64 len;
-	uint64 removed_key = INVALID_KEY;
-	int lowmem = 0;
-	struct lowmemlru_ele *ele = NULL;
-	int i = 0;
-	char rw = 'W';
-	if (argc != 3) {
-		printf("Usage: ./spc_lru <cache percentage> <lowmemsimulation[0/1]> \n");
-		return -1;
-	}
-	
-	get_size ();
-	lru_blocks = size*atoi(argv[1])/100;
-	if (lowmem) {
-		lru_blocks = lru_blocks - ((lru_blocks*3)/2)/100;
-	}
+	uint64 off = start*BLOCK_SIZE;
 
-	table = hash_init(NUM_BUCKETS, hash_func);
-	
-	if (!table) {
-		printf("No  mem available\n");
-		return -1;
+	len = len/BLOCK_SIZE*BLOCK_SIZE;
+	*first = off/cache_bs;
+	if (len == 0) {
+		return 0;
 	}
-	lru = lru_init(atoi(argv[2]), lru_blocks);
+	return (off + len + cache_bs - 1)/cache_bs - *first;
+}
 
-	while (read_spc_trace(&start_blk, &len,  &rw) != EOF) {
-		for (i=0; i<len/BLOCK_SIZE; i++) {
-			if (hash_lookup(table, start_blk+i, (void **)&ele)) {
-				hits++;
-				lru_bump(lru, ele);
-			} else {
-				misses++;
-				hash_insert(table, start_blk+i, lru_insert(lru, start_blk+i, &removed_key));
-				if (removed_key != INVALID_KEY) {
-					hash_delete(table, removed_key, NULL);
-				}
-			}
-		}
-	}
-	printf("%d, %lld %lld %d\n",atoi(argv[1]), hits, misses, table->nelements);
-	return 0;
-}			
- 
-/* ----------------------- low mem lru----------------------- */
+static uint64 now_ns(void)
+{
+	struct timespec ts;
 
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec*1000000000ULL + ts.tv_nsec;
+}
 
-struct lowmemlru * lru_init (uint32 lruPct, uint32 lruSizeInBlks)
+/*
+ * one configuration of the sweep: the exact lru when lowmem is NULL,
+ * else lowmemlru at lruPct pct.
+ */
+struct sweep {
+	uint32 pct;
+	struct lowmemlru *lowmem;
+	struct hash_table *table;
+	struct lru *lru;
+	uint64 hits;
+	uint64 ns;
+};
+
+static uint32 sweep_access(struct sweep *sw, uint64 key)
 {
-	struct lowmemlru * llru = malloc(sizeof(struct lowmemlru));
-	
-	memset((void *)llru, 0, sizeof(struct lowmemlru));
-#if 0
-	llowmemlru->tag_table = malloc(sizeof(struct tagTable)*100(lruPct/2));
-	memset(llowmemlru->tag_table, 0, sizeof(struct tagTable)*100(lruPct/2));
-#endif
-	llru->bumpupCounter = ((lruPct*lruSizeInBlks)/100)/2;
-	llru->lowmemblks = ((lruPct*lruSizeInBlks)/100);
-	llru->cacheSize = lruSizeInBlks;
-	return llru;
-}
+	struct lru_ele *ele;
+	uint64 removed_key;
 
-void decrement_tag_count(struct lowmemlru *lru, struct tagTable *tagEntry);
+	if (sw->lowmem) {
+		return lowmemlru_access(sw->lowmem, key);
+	}
+	if (hash_lookup(sw->table, key, (void **)&ele)) {
+		lru_bump(sw->lru, ele);
+		return SUCCESS;
+	}
+	hash_insert(sw->table, key, lru_insert(sw->lru, key, &removed_key));
+	if (removed_key != INVALID_KEY) {
+		hash_delete(sw->table, removed_key, NULL);
+	}
+	return FAILURE;
+}
 
-static int remove_blk(struct lowmemlru *lru)
+/*
+ * replays the trace once, every request goes through the exact lru and
+ * each lowmemlru configuration in turn, each one timed on its own.
+ */
+static int run_sweep(char *pcts, uint32 flags, struct hash_func_desc *hfunc,
+		uint32 samples, uint64 seed)
 {
-	uint32 rand = 0, count = 0;
-	int i = 0, counter = 0;
-	
-	struct hash * hash_entry = NULL, * prev = NULL;
-	for (counter = 0; counter < 1000; counter++) {
-		rand = random() % table->nelements;
-		rand = rand+1;
-		i=0;
-		while (((count + table->table[i].nelements) < rand) && i < table->num_tables) {
-			count += table->table[i].nelements;
-			i++;
+	struct sweep sw[SWEEP_MAX];
+	uint64 start_blk, len, nblks, first, accesses = 0, t, bytes;
+	uint32 nsw = 1, i, k, nelements;
+	char rw, *p, pct[16];
+
+	memset(sw, 0, sizeof(sw));
+	sw[0].table = hash_init(NUM_BUCKETS, flags & LOWMEM_PACKED ? HASH_CHAINED : flags, hfunc->func);
+	sw[0].lru = lru_init(lru_blocks);
+	if (!sw[0].table || !sw[0].lru) {
+		printf("No  mem available\n");
+		return -1;
+	}
+	sw[0].table->hash_batch = hfunc->batch;
+	for (p = strtok(pcts, ","); p; p = strtok(NULL, ",")) {
+		if (nsw == SWEEP_MAX) {
+			printf("At most %d lru percentages\n", SWEEP_MAX - 1);
+			return -1;
 		}
-		if (!(i < table->num_tables)) {
-			printf("Going beyound buckets\n");
-		} 
-		count = rand - count;
-		hash_entry = table->table[i].next;
-		while (--count && hash_entry)	{
-			prev = hash_entry;
-			hash_entry = hash_entry->next;
+		sw[nsw].pct = atoi(p);
+		sw[nsw].lowmem = lowmemlru_init(sw[nsw].pct, lru_blocks, flags, hfunc->func);
+		if (!sw[nsw].lowmem) {
+			printf("Cannot run lowmem at %u%%\n", sw[nsw].pct);
+			return -1;
 		}
-		if (!hash_entry) {
-			printf("Going beyound entries\n");
+		if (sw[nsw].lowmem->table) {
+			sw[nsw].lowmem->table->hash_batch = hfunc->batch;
 		}
-		if (((struct lowmemlru_ele *)hash_entry->data)->blockTag  <= lru->lowmemlruMaxTag) {
+		lowmemlru_set_sampling(sw[nsw].lowmem, samples, seed);
+		nsw++;
+	}
 
-			if (hash_entry == table->table[i].next) {
-				table->table[i].next = table->table[i].next->next;
-			} else {
-				prev->next = hash_entry->next;
+	while (read_spc_trace(&start_blk, &len,  &rw) != EOF) {
+		nblks = request_blocks(start_blk, len, &first);
+		accesses += nblks;
+		for (k=0; k<nsw; k++) {
+			t = now_ns();
+			for (i=0; i<nblks; i++) {
+				if (sweep_access(&sw[k], first+i)) {
+					sw[k].hits++;
+				}
 			}
-			table->table[i].nelements--;
-			// remove entry from lru.
-			decrement_tag_count (lru, lru->tagTable);		
-			return 0;
+			sw[k].ns += now_ns() - t;
 		}
 	}
-	printf("--------Didnt find in 1000 iterations\n");
-	return 1 ;
-}
 
-static void incement_lowmemlru_iocounter(struct lowmemlru *lru)
-{
-	struct tagTable *table = NULL;
-	lru->ioCounter++;
-	if (lru->ioCounter == lru->bumpupCounter) {
-		table = malloc(sizeof(*table));
-		memset(table, 0, sizeof(*table));
-		lru->ioCounter = 0;
-		table->tagTable = lru->globalTag++;
-		table->tagIOCount = lru->bumpupCounter;
-		if (lru->latestEntry == NULL) {
-			lru->latestEntry = lru->tagTable = table;
+	printf("%-8s %6s %12s %11s %8s %9s\n", "policy", "lruPct", "bytes", "bytes/block", "hit%", "ns/access");
+	for (k=0; k<nsw; k++) {
+		if (sw[k].lowmem) {
+			bytes = lowmemlru_memory(sw[k].lowmem);
+			nelements = lowmemlru_num_elements(sw[k].lowmem);
+		} else {
+			bytes = hash_memory(sw[k].table) + lru_memory(sw[k].lru);
+			nelements = hash_num_elements(sw[k].table);
+		}
+		if (sw[k].lowmem) {
+			snprintf(pct, sizeof(pct), "%u", sw[k].pct);
 		} else {
-			lru->latestEntry->next = table;
-			lru->latestEntry = table;
+			strcpy(pct, "-");
 		}
+		printf("%-8s %6s %12llu %11.1f %8.3f %9.1f\n", sw[k].lowmem ? "lowmem" : "lru", pct, bytes, nelements ? (double)bytes/nelements : 0.0,
+			accesses ? 100.0*sw[k].hits/accesses : 0.0,
+			accesses ? (double)sw[k].ns/accesses : 0.0);
 	}
-	return ;
-}
-struct lowmemlru_ele* 
-lru_insert (struct lowmemlru *lru, uint64 key, uint64 *removed_key)
-{
-	struct lowmemlru_ele* ele = malloc(sizeof(struct lowmemlru_ele));
-	memset(ele, 0, sizeof(struct lowmemlru_ele));
-	ele->key = key;
-	ele->blockTag = lru->globalTag;
-	incement_lowmemlru_iocounter(lru);
-	lru->blocksPresent++;
-	if (lru->blocksPresent > lru->cacheSize) {
-		while (remove_blk (lru)); 
-		lru->blocksPresent--;
-	}
-	return ele;
+	for (k=0; k<nsw; k++) {
+		if (sw[k].lowmem) {
+			lowmemlru_destroy(sw[k].lowmem);
+		} else {
+			hash_destroy(sw[k].table);
+			lru_destroy(sw[k].lru);
+		}
+	}
+	return 0;
 }
-void decrement_tag_count(struct lowmemlru *lru, struct tagTable *tagEntry)
+
+int main(int argc, char **argv) 
 {
-	struct tagTable *tmp = NULL;
-	tagEntry->tagIOCount--;
+	uint64 start_blk = 0;
+	uint64 len;
+	uint64 removed_key = INVALID_KEY;
+	int lowmem = 0;
+	int lowmem_packed = 0;
+	char *sweep = NULL;
+	struct lowmemlru_ele *eles[HASH_BATCH];
+	uint64 keys[HASH_BATCH];
+	uint64 nblks, first;
+	int i = 0, j, n;
+	char rw = 'W';
+	uint32 hash_type = HASH_CHAINED;
+	struct hash_func_desc *hfunc = NULL;
+	int opt;
+	int verbose = 0;
+	char *json_file = NULL;
+	FILE *fp;
+	uint64 meta;
+	uint32 nblocks;
+	uint32 samples = LOWMEM_SAMPLES;
+	uint64 seed = LOWMEM_SEED;
+
+	while ((opt = getopt(argc, argv, "H:F:vb:j:Pk:s:S:")) != -1) {
+		switch (opt) {
+		case 'H':
+			if (!strcmp(optarg, "open")) {
+				hash_type = HASH_OPEN;
+			} else if (strcmp(optarg, "chained")) {
+				printf("Unknown hash table type %s\n", optarg);
+				return -1;
+			}
+			break;
+		case 'b':
+			cache_bs = strtoull(optarg, NULL, 0);
+			if (cache_bs == 0 || cache_bs % BLOCK_SIZE) {
+				printf("Cache block size must be a multiple of %d\n", BLOCK_SIZE);
+				return -1;
+			}
+			break;
+		case 'F':
+			hfunc = hash_func_find(optarg);
+			if (!hfunc) {
+				printf("Unknown hash function %s, one of: ", optarg);
+				hash_func_list(stdout);
+				return -1;
+			}
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		case 'j':
+			json_file = optarg;
+			break;
+		case 'P':
+			lowmem_packed = 1;
+			break;
+		case 'k':
+			samples = atoi(optarg);
+			if (samples == 0) {
+				printf("Need at least one eviction sample\n");
+				return -1;
+			}
+			break;
+		case 's':
+			seed = strtoull(optarg, NULL, 0);
+			break;
+		case 'S':
+			sweep = optarg;
+			break;
+		default:
+			argc = 0;
+		}
+	}
+	// a sweep brings its own lru percentages
+	if (argc - optind != 2 && !(sweep && argc - optind == 1)) {
+		printf("Usage: ./spc_lowmem_lru [-H chained|open] [-F hash function] [-b block bytes] [-P] [-k samples] [-s seed] [-S lrupct,lrupct,...] [-v] [-j stats.json] <cache percentage> <lru percentage> \n");
+		return -1;
+	}
+	argv += optind - 1;
+	
+	get_size ();
+	lru_blocks = size*atoi(argv[1])/100;
+	if (lowmem) {
+		lru_blocks = lru_blocks - ((lru_blocks*3)/2)/100;
+	}
+	lru_blocks = lru_blocks*BLOCK_SIZE/cache_bs;
+
 	/*
-	 * if its the first tag entry then see to it that there are lrupct blocks in there
+	 * chains are fine with the plain block number, linear probing
+	 * clusters badly on runs of sequential blocks without a mixing hash.
 	 */
-	if (tagEntry->tagTable == lru->lowmemlruMaxTag) {
-		if (tagEntry->tagIOCount < lru->lowmemblks) {
-			if (tagEntry->next != NULL) {
-				tagEntry->next->tagIOCount += tagEntry->tagIOCount;
-				lru->tagTable = tagEntry->next;
-				tagEntry->next = NULL;
-				free(tagEntry);
+	if (!hfunc) {
+		hfunc = hash_func_find(hash_type == HASH_OPEN ? "murmur" : "identity");
+	}
+	if (sweep) {
+		return run_sweep(sweep, lowmem_packed ? LOWMEM_PACKED : hash_type, hfunc, samples, seed);
+	}
+	lru = lowmemlru_init(atoi(argv[2]), lru_blocks, lowmem_packed ? LOWMEM_PACKED : hash_type, hfunc->func);
+	if (!lru) {
+		printf("Cannot run lowmem with this cache size and lru percentage\n");
+		return -1;
+	}
+	lowmemlru_set_sampling(lru, samples, seed);
+	table = lru->table;
+	if (table) {
+		table->hash_batch = hfunc->batch;
+	}
+
+	while (read_spc_trace(&start_blk, &len,  &rw) != EOF) {
+		nblks = request_blocks(start_blk, len, &first);
+		if (!table) {
+			for (i=0; i<nblks; i++) {
+				if (lowmemlru_access(lru, first+i)) {
+					hits++;
+				} else {
+					misses++;
+				}
 			}
+			continue;
 		}
-	} else {
-		if (tagEntry->next) {
-			if (((tagEntry->tagIOCount + tagEntry->next->tagIOCount) < (lru->bumpupCounter)) && 
-						tagEntry->next){
-				tagEntry->tagIOCount += tagEntry->next->tagIOCount;
-				tagEntry->tagTable = tagEntry->next->tagTable;
-				tmp = tagEntry->next;
-				tagEntry->next = tagEntry->next->next;
-				if (tmp == lru->latestEntry) {
-					lru->latestEntry = tagEntry;
+		for (i=0; i<nblks; i+=n) {
+			n = nblks - i < HASH_BATCH ? nblks - i : HASH_BATCH;
+			for (j=0; j<n; j++) {
+				keys[j] = first+i+j;
+			}
+			hash_lookup_batch(table, keys, n, (void **)eles);
+			for (j=0; j<n; j++) {
+				if (eles[j]) {
+					hits++;
+					lowmemlru_bump(lru, eles[j]);
+					continue;
+				}
+				misses++;
+				hash_insert(table, keys[j], lowmemlru_insert(lru, keys[j], &removed_key));
+				if (removed_key != INVALID_KEY) {
+					hash_delete(table, removed_key, NULL);
+					// a block later in this batch may just have been evicted
+					if (removed_key > keys[j] && removed_key < keys[0]+n) {
+						eles[removed_key-keys[0]] = NULL;
+					}
 				}
-				free(tmp);
 			}
 		}
 	}
-	return;
-}
-uint32 lru_bump(struct lowmemlru*lru, struct lowmemlru_ele* ele)
-{
-	struct tagTable *tagEntry = lru->tagTable;
-	if (ele->blockTag > lru->latestEntry->tagTable) {
-		return;
+	nblocks = lowmemlru_num_elements(lru);
+	printf("%d, %lld %lld %d\n",atoi(argv[1]), hits, misses, nblocks);
+	meta = lowmemlru_memory(lru);
+	fprintf(stderr, "metadata %llu bytes, %.1f bytes/block\n", meta,
+		nblocks ? (double)meta/nblocks : 0.0);
+	if (verbose && table && table->pool) {
+		pool_print_stats(table->pool, "hash", stderr);
 	}
-	lru->ioCounter++;
-	while ((tagEntry->tagTable < ele->blockTag)) {
-		tagEntry= tagEntry->next;
+	if (json_file && table) {
+		fp = strcmp(json_file, "-") ? fopen(json_file, "w") : stdout;
+		if (fp == NULL) {
+			printf("Cannot open %s\n", json_file);
+		} else {
+			hash_stats_dump_json(table, fp);
+			if (fp != stdout)
+				fclose(fp);
+		}
 	}
-	decrement_tag_count(lru, tagEntry);
-	
-	return;
+	lowmemlru_destroy(lru);
+	trace_close(trace);
+	return 0;
 }
-
-
-
-
@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "types.h"
+#include "shard_lru.h"
+#include "prng.h"
+
+#define MAX_THREADS	(256)
+
+struct shard_lru *sl = NULL;
+uint64 ops = 1000000;
+uint64 nkeys = 4000000;
+uint32 cache_blocks = 1000000;
+uint32 hot_pct = 80;
+uint32 rebalance_us = 0;
+volatile int running = 0;
+
+struct worker {
+	pthread_t thread;
+	uint64 seed;
+};
+
+/* hot_pct of the accesses go to the first 10% of the keys */
+static void *worker(void *arg)
+{
+	struct worker * w = arg;
+	uint64 i, r, k, removed;
+
+	for (i = 0; i < ops; i++) {
+		r = prng_next(&w->seed);
+		if ((r & 0xFF)*100 < hot_pct*256) {
+			k = (r >> 8) % (nkeys/10 + 1);
+		} else {
+			k = (r >> 8) % nkeys;
+		}
+		shard_lru_access(sl, k, &removed);
+	}
+	return NULL;
+}
+
+static void *rebalancer(void *arg)
+{
+	while (running) {
+		shard_lru_rebalance(sl, 64);
+		usleep(rebalance_us);
+	}
+	return NULL;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+static double run(uint32 threads, uint32 nshards, double *hit_pct)
+{
+	struct worker w[MAX_THREADS];
+	pthread_t rb;
+	uint64 hits, misses;
+	double start, elapsed;
+	uint32 i;
+
+	sl = shard_lru_init(nshards, cache_blocks);
+	if (!sl) {
+		printf("No  mem available\n");
+		exit(-1);
+	}
+	memset(w, 0, sizeof(w));
+	for (i = 0; i < threads; i++) {
+		w[i].seed = 0x9e3779b97f4a7c15ULL*(i + 1);
+	}
+	running = 1;
+	if (rebalance_us) {
+		pthread_create(&rb, NULL, rebalancer, NULL);
+	}
+	start = now();
+	for (i = 0; i < threads; i++) {
+		pthread_create(&w[i].thread, NULL, worker, &w[i]);
+	}
+	for (i = 0; i < threads; i++) {
+		pthread_join(w[i].thread, NULL);
+	}
+	elapsed = now() - start;
+	running = 0;
+	if (rebalance_us) {
+		pthread_join(rb, NULL);
+	}
+	shard_lru_stats(sl, &hits, &misses);
+	*hit_pct = 100.0*hits/(hits + misses);
+	if (shard_lru_num_elements(sl) > cache_blocks) {
+		printf("cache over capacity %lld\n", shard_lru_num_elements(sl));
+	}
+	shard_lru_destroy(sl);
+	return elapsed;
+}
+
+int main(int argc, char **argv)
+{
+	uint32 max_threads = 64;
+	uint32 nshards = 64;
+	uint32 t;
+	double elapsed, hit_pct, base = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "t:s:n:k:c:h:R:")) != -1) {
+		switch (opt) {
+		case 't':
+			max_threads = atoi(optarg);
+			break;
+		case 's':
+			nshards = atoi(optarg);
+			break;
+		case 'n':
+			ops = strtoull(optarg, NULL, 0);
+			break;
+		case 'k':
+			nkeys = strtoull(optarg, NULL, 0);
+			break;
+		case 'c':
+			cache_blocks = strtoul(optarg, NULL, 0);
+			break;
+		case 'h':
+			hot_pct = atoi(optarg);
+			break;
+		case 'R':
+			rebalance_us = atoi(optarg);
+			break;
+		default:
+			printf("Usage: ./shard_lru_bench [-t max threads] [-s shards] [-n ops per thread] [-k keys] [-c cache blocks] [-h hot pct] [-R rebalance usecs]\n");
+			return -1;
+		}
+	}
+	if (max_threads == 0 || max_threads > MAX_THREADS || nkeys == 0) {
+		printf("Invalid thread count\n");
+		return -1;
+	}
+	printf("threads, Mops/s, speedup, hit%%\n");
+	for (t = 1; ; t = (t << 1) > max_threads ? max_threads : t << 1) {
+		elapsed = run(t, nshards, &hit_pct);
+		if (t == 1)	base = ops/elapsed;
+		printf("%u, %.2f, %.2f, %.2f\n", t, ops*t/elapsed/1e6, ops*t/elapsed/base, hit_pct);
+		if (t == max_threads)	break;
+	}
+	return 0;
+}
@@ -1,44 +1,551 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <strings.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
 
 #include "types.h"
+#include "trace.h"
 #include "hash.h"
+#include "hash_funcs.h"
 #include "lru.h"
+#include "extent.h"
+#include "policy.h"
+#include "mrc.h"
+#include "spsc.h"
 
-#define NUM_BUCKETS	(10000000)
+#define NUM_BUCKETS	(1024)
 #define BLOCK_SIZE (512)
 uint64 size = 0;
 uint64 lru_blocks = 0;
+uint64 cache_bs = BLOCK_SIZE;
 
 struct hash_table*table = NULL;
 struct lru * lru = NULL;
+struct policy * policy = NULL;
+void * cache = NULL;
+struct extent_index * extents = NULL;
 uint64 hits = 0, misses = 0;
-uint64 hash_func (struct hash_table*table, uint64 key) 
-{
-	return key % table->num_tables;
-}
+/* stdin through the trace reader, a batch at a time */
+struct trace *trace = NULL;
+struct trace_rec recs[TRACE_BATCH];
+uint32 nrecs = 0, next_rec = 0;
 
 void get_size ()
 {
-	scanf("%lld\n",&size);
+	trace = trace_open(NULL);
+	if (!trace || !trace_read_size(trace, &size)) {
+		printf("Cannot read the trace\n");
+		exit(-1);
+	}
 }
 
 int read_spc_trace(uint64 *start, uint64 *len, char *rw)
 {
-	return scanf("%lld %lld %c",start,len,rw);
+	if (next_rec == nrecs) {
+		nrecs = trace_next_batch(trace, recs, TRACE_BATCH);
+		next_rec = 0;
+		if (nrecs == 0) {
+			return EOF;
+		}
+	}
+	*start = recs[next_rec].start;
+	*len = recs[next_rec].len;
+	*rw = recs[next_rec].rw;
+	next_rec++;
+	return 3;
+}
+/*
+ * cache blocks covered by a request, start is in 512 byte sectors.
+ */
+uint64 request_blocks(uint64 start, uint64 len, uint64 *first)
+{
+	uint64 off = start*BLOCK_SIZE;
+
+	len = len/BLOCK_SIZE*BLOCK_SIZE;
+	*first = off/cache_bs;
+	if (len == 0) {
+		return 0;
+	}
+	return (off + len + cache_bs - 1)/cache_bs - *first;
+}
+
+/*
+ * -M: one pass computes the lru hits of every cache percentage from the
+ * stack distances, printed the way separate runs would print them. -R
+ * and -K only track a spatially hashed sample of the blocks.
+ */
+#define MRC_POINTS	(100)
+
+int run_mrc(int lowmem, double rate, uint32 max_samples, int verbose)
+{
+	struct mrc *mrc = mrc_init();
+	uint64 sizes[MRC_POINTS], mrc_hits_at[MRC_POINTS];
+	uint64 start_blk, len, nblks, first, i, blocks;
+	char rw;
+	int pct;
+
+	if (!mrc) {
+		printf("No  mem available\n");
+		return -1;
+	}
+	if ((rate < 1 || max_samples) && !mrc_set_sampling(mrc, rate, max_samples)) {
+		printf("Sampling rate must be in (0, 1]\n");
+		return -1;
+	}
+	while (read_spc_trace(&start_blk, &len,  &rw) != EOF) {
+		nblks = request_blocks(start_blk, len, &first);
+		for (i=0; i<nblks; i++) {
+			mrc_access(mrc, first+i);
+		}
+	}
+	for (pct=1; pct<=MRC_POINTS; pct++) {
+		blocks = size*pct/100;
+		if (lowmem) {
+			blocks = blocks - ((blocks*3)/2)/100;
+		}
+		sizes[pct-1] = blocks*BLOCK_SIZE/cache_bs;
+	}
+	mrc_hits(mrc, sizes, MRC_POINTS, mrc_hits_at);
+	for (pct=1; pct<=MRC_POINTS; pct++) {
+		// an lru holds every block seen until it fills up
+		blocks = mrc_blocks(mrc);
+		if (sizes[pct-1] < blocks) {
+			blocks = sizes[pct-1];
+		}
+		printf("%d, %lld %lld %lld\n", pct, mrc_hits_at[pct-1],
+			mrc->accesses - mrc_hits_at[pct-1], blocks);
+	}
+	if (verbose) {
+		fprintf(stderr, "mrc tracked %.0f of %llu accesses, rate %.6f, %llu bytes\n",
+			mrc->sampled*mrc->scale, mrc->accesses, (double)mrc->threshold/MRC_HASH_SPACE,
+			mrc_memory(mrc));
+	}
+	mrc_destroy(mrc);
+	return 0;
+}
+
+/*
+ * -T: the replay as a pipeline of three threads, the trace reader, the
+ * expansion of requests into hashed block numbers and the simulation on
+ * the main thread. batches go down one spsc ring and come back empty on
+ * another, nothing is allocated once it runs. an empty batch ends it.
+ */
+#define PIPE_KEYS	(4096)
+
+struct key_batch {
+	uint64 keys[PIPE_KEYS];
+	uint64 hashes[PIPE_KEYS];
+	uint32 n;
+};
+
+struct pipe_stage {
+	const char *name;
+	const char *unit;
+	uint64 items;
+	uint64 ns;
+	/* blocked on a ring */
+	uint64 wait_ns;
+};
+
+struct spsc_ring rec_full, rec_free, key_full, key_free;
+struct pipe_stage stages[3] = {
+	{ "read", "records" }, { "expand", "blocks" }, { "simulate", "blocks" },
+};
+
+static uint64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec*1000000000ULL + ts.tv_nsec;
+}
+
+static void * pipe_pop(struct spsc_ring *ring, struct pipe_stage *st)
+{
+	uint64 t;
+	void * p;
+
+	if (spsc_pop(ring, &p)) {
+		return p;
+	}
+	t = now_ns();
+	while (!spsc_pop(ring, &p)) {
+		sched_yield();
+	}
+	st->wait_ns += now_ns() - t;
+	return p;
+}
+
+static void pipe_push(struct spsc_ring *ring, void *p, struct pipe_stage *st)
+{
+	uint64 t;
+
+	if (spsc_push(ring, p)) {
+		return;
+	}
+	t = now_ns();
+	while (!spsc_push(ring, p)) {
+		sched_yield();
+	}
+	st->wait_ns += now_ns() - t;
+}
+
+static void * pipe_read(void *arg)
+{
+	struct pipe_stage *st = &stages[0];
+	struct trace_batch *b;
+	uint64 t = now_ns();
+
+	do {
+		b = pipe_pop(&rec_free, st);
+		b->n = trace_next_batch(trace, b->recs, TRACE_BATCH);
+		st->items += b->n;
+		pipe_push(&rec_full, b, st);
+	} while (b->n);
+	st->ns = now_ns() - t;
+	return NULL;
+}
+
+static struct key_batch * pipe_send_keys(struct key_batch *k, struct pipe_stage *st)
+{
+	uint32 i;
+
+	if (table->hash_batch) {
+		table->hash_batch(k->keys, k->n, k->hashes);
+	} else {
+		for (i=0; i<k->n; i++) {
+			k->hashes[i] = table->hash_func(table, k->keys[i]);
+		}
+	}
+	st->items += k->n;
+	pipe_push(&key_full, k, st);
+	k = pipe_pop(&key_free, st);
+	k->n = 0;
+	return k;
+}
+
+static void * pipe_expand(void *arg)
+{
+	struct pipe_stage *st = &stages[1];
+	struct trace_batch *b;
+	struct key_batch *k;
+	uint64 nblks, first, i;
+	uint64 t = now_ns();
+	uint32 r;
+
+	k = pipe_pop(&key_free, st);
+	k->n = 0;
+	for (;;) {
+		b = pipe_pop(&rec_full, st);
+		if (b->n == 0) {
+			// back where run_pipeline frees it
+			pipe_push(&rec_free, b, st);
+			break;
+		}
+		for (r=0; r<b->n; r++) {
+			nblks = request_blocks(b->recs[r].start, b->recs[r].len, &first);
+			for (i=0; i<nblks; i++) {
+				k->keys[k->n++] = first+i;
+				if (k->n == PIPE_KEYS) {
+					k = pipe_send_keys(k, st);
+				}
+			}
+		}
+		pipe_push(&rec_free, b, st);
+	}
+	if (k->n) {
+		k = pipe_send_keys(k, st);
+	}
+	pipe_push(&key_full, k, st);
+	st->ns = now_ns() - t;
+	return NULL;
 }
+
+/* the usual per block replay, on blocks that can span requests */
+static void pipe_simulate(struct key_batch *k)
+{
+	struct lru_ele *eles[HASH_BATCH], *ele;
+	uint64 removed_key;
+	uint32 i, j, l, n;
+
+	for (i=0; i<k->n; i+=n) {
+		n = k->n - i < HASH_BATCH ? k->n - i : HASH_BATCH;
+		hash_lookup_batch_hashed(table, k->keys+i, k->hashes+i, n, (void **)eles);
+		for (j=0; j<n; j++) {
+			if (eles[j]) {
+				hits++;
+				policy->bump(cache, eles[j]);
+				continue;
+			}
+			misses++;
+			ele = policy->insert(cache, k->keys[i+j], &removed_key);
+			hash_insert(table, k->keys[i+j], ele);
+			// a later block of the batch may be this one again or the evicted one
+			for (l=j+1; l<n; l++) {
+				if (k->keys[i+l] == k->keys[i+j]) {
+					eles[l] = ele;
+				} else if (k->keys[i+l] == removed_key) {
+					eles[l] = NULL;
+				}
+			}
+			if (removed_key != INVALID_KEY) {
+				hash_delete(table, removed_key, NULL);
+			}
+		}
+	}
+}
+
+int run_pipeline(void)
+{
+	struct pipe_stage *st = &stages[2];
+	struct key_batch *k;
+	pthread_t reader, expander;
+	uint64 t;
+	uint32 i;
+
+	for (i=0; i<SPSC_SIZE; i++) {
+		k = malloc(sizeof(struct trace_batch));
+		if (!k || !spsc_push(&rec_free, k)) {
+			printf("No  mem available\n");
+			return FAILURE;
+		}
+		k = malloc(sizeof(struct key_batch));
+		if (!k || !spsc_push(&key_free, k)) {
+			printf("No  mem available\n");
+			return FAILURE;
+		}
+	}
+	t = now_ns();
+	if (pthread_create(&reader, NULL, pipe_read, NULL) ||
+			pthread_create(&expander, NULL, pipe_expand, NULL)) {
+		printf("Could not start the pipeline threads\n");
+		return FAILURE;
+	}
+	for (;;) {
+		k = pipe_pop(&key_full, st);
+		if (k->n == 0) {
+			break;
+		}
+		pipe_simulate(k);
+		st->items += k->n;
+		pipe_push(&key_free, k, st);
+	}
+	st->ns = now_ns() - t;
+	pthread_join(reader, NULL);
+	pthread_join(expander, NULL);
+	free(k);
+	while (spsc_pop(&key_free, (void **)&k) || spsc_pop(&key_full, (void **)&k)) {
+		free(k);
+	}
+	while (spsc_pop(&rec_free, (void **)&k) || spsc_pop(&rec_full, (void **)&k)) {
+		free(k);
+	}
+	for (i=0; i<3; i++) {
+		st = &stages[i];
+		t = st->ns > st->wait_ns ? st->ns - st->wait_ns : 1;
+		fprintf(stderr, "%-8s %10llu %-7s %8.2f M/s busy %.3fs waiting %.3fs\n",
+			st->name, st->items, st->unit, st->items*1000.0/t, t/1e9, st->wait_ns/1e9);
+	}
+	return SUCCESS;
+}
+
+/*
+ * -B: a whole request at a time, in request order. runs of misses go
+ * into the lru with one lru_insert_batch and their evictions leave the
+ * hash table together. a hit first flushes the misses before it, and
+ * once anything was evicted it is looked up again, an earlier miss of
+ * the same request may have pushed it out.
+ */
+uint64 *req_keys = NULL, *req_miss = NULL, *req_removed = NULL;
+struct lru_ele **req_eles = NULL, **req_new = NULL;
+uint64 req_size = 0;
+
+static uint64 flush_misses(uint64 nmiss)
+{
+	uint64 i, nremoved;
+
+	nremoved = lru_insert_batch(lru, req_miss, nmiss, req_new, req_removed);
+	hash_delete_batch(table, req_removed, nremoved);
+	for (i=0; i<nmiss; i++) {
+		if (req_new[i])
+			hash_insert(table, req_miss[i], req_new[i]);
+	}
+	return nremoved;
+}
+
+int access_request(uint64 first, uint64 nblks)
+{
+	uint64 i, n, nmiss = 0, nevicted = 0;
+	uint64 slack = lru->max_elements - lru->low_mark;
+	struct lru_ele *ele;
+
+	if (nblks > req_size) {
+		req_size = nblks;
+		req_keys = realloc(req_keys, sizeof(uint64)*req_size);
+		req_miss = realloc(req_miss, sizeof(uint64)*req_size);
+		req_eles = realloc(req_eles, sizeof(struct lru_ele *)*req_size);
+		req_new = realloc(req_new, sizeof(struct lru_ele *)*req_size);
+		req_removed = realloc(req_removed, sizeof(uint64)*(req_size + slack));
+		if (!req_keys || !req_miss || !req_eles || !req_new || !req_removed) {
+			return FAILURE;
+		}
+	}
+	for (i=0; i<nblks; i++) {
+		req_keys[i] = first+i;
+	}
+	for (i=0; i<nblks; i+=n) {
+		n = nblks - i < HASH_BATCH ? nblks - i : HASH_BATCH;
+		hash_lookup_batch(table, req_keys+i, n, (void **)req_eles+i);
+	}
+	for (i=0; i<nblks; i++) {
+		ele = req_eles[i];
+		if (ele && nmiss) {
+			nevicted += flush_misses(nmiss);
+			nmiss = 0;
+		}
+		if (ele && nevicted && !hash_lookup(table, req_keys[i], (void **)&ele)) {
+			ele = NULL;
+		}
+		if (ele) {
+			hits++;
+			lru_bump(lru, ele);
+		} else {
+			misses++;
+			req_miss[nmiss++] = req_keys[i];
+		}
+	}
+	if (nmiss) {
+		flush_misses(nmiss);
+	}
+	return SUCCESS;
+}
+
 int main(int argc, char **argv) 
 {
 	uint64 start_blk = 0;
 	uint64 len;
 	uint64 removed_key = INVALID_KEY;
 	int lowmem = 0;
-	struct lru_ele *ele = NULL;
-	int i = 0;
+	void *eles[HASH_BATCH];
+	uint64 keys[HASH_BATCH];
+	uint64 nblks, first;
+	int i = 0, j, n;
 	char rw = 'W';
-	if (argc != 3) {
-		printf("Usage: ./spc_lru <cache percentage> <lowmemsimulation[0/1]> \n");
+	uint32 hash_type = HASH_CHAINED;
+	struct hash_func_desc *hfunc = NULL;
+	int opt;
+	int verbose = 0;
+	uint64 meta;
+	char *json_file = NULL;
+	FILE *fp;
+	int extent_mode = 0;
+	int intrusive = 0;
+	int batch = 0;
+	int mrc_mode = 0;
+	int pipeline = 0;
+	double mrc_rate = 1;
+	uint32 mrc_max = 0;
+	uint32 low_pct = 0;
+	struct lru_ele *ele;
+
+	while ((opt = getopt(argc, argv, "H:F:vb:eij:p:BW:MR:K:T")) != -1) {
+		switch (opt) {
+		case 'H':
+			if (!strcmp(optarg, "open")) {
+				hash_type = HASH_OPEN;
+			} else if (strcmp(optarg, "chained")) {
+				printf("Unknown hash table type %s\n", optarg);
+				return -1;
+			}
+			break;
+		case 'e':
+			extent_mode = 1;
+			break;
+		case 'i':
+			intrusive = 1;
+			break;
+		case 'B':
+			batch = 1;
+			break;
+		case 'M':
+			mrc_mode = 1;
+			break;
+		case 'T':
+			pipeline = 1;
+			break;
+		case 'R':
+			mrc_mode = 1;
+			mrc_rate = atof(optarg);
+			break;
+		case 'K':
+			mrc_mode = 1;
+			mrc_max = atoi(optarg);
+			break;
+		case 'W':
+			batch = 1;
+			low_pct = atoi(optarg);
+			if (low_pct >= 100) {
+				printf("Watermark must be below 100%%\n");
+				return -1;
+			}
+			break;
+		case 'p':
+			policy = policy_find(optarg);
+			if (!policy) {
+				printf("Unknown policy %s, one of: ", optarg);
+				policy_list(stdout);
+				return -1;
+			}
+			break;
+		case 'b':
+			cache_bs = strtoull(optarg, NULL, 0);
+			if (cache_bs == 0 || cache_bs % BLOCK_SIZE) {
+				printf("Cache block size must be a multiple of %d\n", BLOCK_SIZE);
+				return -1;
+			}
+			break;
+		case 'F':
+			hfunc = hash_func_find(optarg);
+			if (!hfunc) {
+				printf("Unknown hash function %s, one of: ", optarg);
+				hash_func_list(stdout);
+				return -1;
+			}
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		case 'j':
+			json_file = optarg;
+			break;
+		default:
+			argc = 0;
+		}
+	}
+	if (mrc_mode && argc - optind <= 1) {
+		// every percentage at once, only the lowmem flag matters
+		get_size ();
+		return run_mrc(argc - optind == 1 ? atoi(argv[optind]) : 0, mrc_rate, mrc_max, verbose);
+	}
+	if (argc - optind != 2) {
+		printf("Usage: ./spc_lru [-H chained|open] [-F hash function] [-b block bytes] [-p policy] [-e] [-i] [-B] [-W evict pct] [-T] [-v] [-j stats.json] <cache percentage> <lowmemsimulation[0/1]> \n");
+		printf("       ./spc_lru -M [-R sample rate] [-K max samples] [-b block bytes] [-v] [lowmemsimulation[0/1]]\n");
+		return -1;
+	}
+	argv += optind - 1;
+	if (!policy) {
+		policy = policy_find("lru");
+	}
+	if ((intrusive || extent_mode || batch) && strcmp(policy->name, "lru")) {
+		printf("-i, -e and -B only work with the lru policy\n");
+		return -1;
+	}
+	if (pipeline && (intrusive || extent_mode || batch)) {
+		printf("-T does not go with -i, -e or -B\n");
 		return -1;
 	}
 	
@@ -48,30 +555,133 @@ int main(int argc, char **argv)
 	if (lowmem) {
 		lru_blocks = lru_blocks - ((lru_blocks*3)/2)/100;
 	}
+	lru_blocks = lru_blocks*BLOCK_SIZE/cache_bs;
 
-	table = hash_init(NUM_BUCKETS, hash_func);
+	/*
+	 * chains are fine with the plain block number, linear probing
+	 * clusters badly on runs of sequential blocks without a mixing hash.
+	 */
+	if (!hfunc) {
+		hfunc = hash_func_find(hash_type == HASH_OPEN ? "murmur" : "identity");
+	}
+	// start small, the table grows with the working set
+	table = hash_init(NUM_BUCKETS, hash_type, hfunc->func);
 	
 	if (!table) {
 		printf("No  mem available\n");
 		return -1;
 	}
-	lru = lru_init(lru_blocks);
+	table->hash_batch = hfunc->batch;
+	if (intrusive) {
+		cache = lru = lru_init_flags(lru_blocks, LRU_INTRUSIVE);
+	} else {
+		cache = policy->init(lru_blocks);
+	}
+	if (!cache) {
+		printf("No  mem available\n");
+		return -1;
+	}
+	if (!strcmp(policy->name, "lru")) {
+		lru = cache;
+		lru_set_low_watermark(lru, lru_blocks - lru_blocks*low_pct/100);
+	}
+	if (extent_mode) {
+		extents = extent_init(lru_blocks, 0);
+		if (!extents) {
+			printf("No  mem available\n");
+			return -1;
+		}
+	}
 
-	while (read_spc_trace(&start_blk, &len,  &rw) != EOF) {
-		for (i=0; i<len/BLOCK_SIZE; i++) {
-			if (hash_lookup(table, start_blk+i, (void **)&ele)) {
-				hits++;
-				lru_bump(lru, ele);
-			} else {
+	if (pipeline && !run_pipeline()) {
+		return -1;
+	}
+	while (!pipeline && read_spc_trace(&start_blk, &len,  &rw) != EOF) {
+		nblks = request_blocks(start_blk, len, &first);
+		if (extents) {
+			extent_access(extents, first, nblks, &hits, &misses);
+			continue;
+		}
+		if (batch && !intrusive) {
+			if (!access_request(first, nblks)) {
+				printf("No  mem available\n");
+				return -1;
+			}
+			continue;
+		}
+		if (intrusive) {
+			// the lru indexes the blocks itself, the hash table stays empty
+			for (i=0; i<nblks; i++) {
+				ele = lru_lookup(lru, first+i);
+				if (ele) {
+					hits++;
+					lru_bump(lru, ele);
+				} else {
+					misses++;
+					lru_insert(lru, first+i, &removed_key);
+				}
+			}
+			continue;
+		}
+		for (i=0; i<nblks; i+=n) {
+			n = nblks - i < HASH_BATCH ? nblks - i : HASH_BATCH;
+			for (j=0; j<n; j++) {
+				keys[j] = first+i+j;
+			}
+			hash_lookup_batch(table, keys, n, (void **)eles);
+			for (j=0; j<n; j++) {
+				if (eles[j]) {
+					hits++;
+					policy->bump(cache, eles[j]);
+					continue;
+				}
 				misses++;
-				hash_insert(table, start_blk+i, lru_insert(lru, start_blk+i, &removed_key));
+				hash_insert(table, keys[j], policy->insert(cache, keys[j], &removed_key));
 				if (removed_key != INVALID_KEY) {
 					hash_delete(table, removed_key, NULL);
+					// a block later in this batch may just have been evicted
+					if (removed_key > keys[j] && removed_key < keys[0]+n) {
+						eles[removed_key-keys[0]] = NULL;
+					}
 				}
 			}
 		}
 	}
-	printf("%d, %lld %lld %lld\n",atoi(argv[1]), hits, misses, table->nelements);
+	if (extents) {
+		printf("%d, %lld %lld %lld\n",atoi(argv[1]), hits, misses, extent_num_blocks(extents));
+	} else if (intrusive) {
+		printf("%d, %lld %lld %d\n",atoi(argv[1]), hits, misses, policy->num_elements(cache));
+	} else {
+		printf("%d, %lld %lld %lld\n",atoi(argv[1]), hits, misses, table->nelements);
+	}
+	if (verbose) {
+		if (table->pool)
+			pool_print_stats(table->pool, "hash", stderr);
+		if (!strcmp(policy->name, "lru") && ((struct lru *)cache)->pool)
+			pool_print_stats(((struct lru *)cache)->pool, "lru", stderr);
+		fprintf(stderr, "%s bytes %llu\n", policy->name, policy->memory(cache));
+		meta = hash_memory(table) + policy->memory(cache);
+		fprintf(stderr, "metadata %llu bytes, %.1f bytes/block\n", meta,
+			policy->num_elements(cache) ? (double)meta/policy->num_elements(cache) : 0.0);
+		if (extents) {
+			fprintf(stderr, "extents %u\n", extent_num_extents(extents));
+			pool_print_stats(extents->extent_pool, "extent", stderr);
+		}
+	}
+	if (json_file) {
+		fp = strcmp(json_file, "-") ? fopen(json_file, "w") : stdout;
+		if (fp == NULL) {
+			printf("Cannot open %s\n", json_file);
+		} else {
+			hash_stats_dump_json(table, fp);
+			if (fp != stdout)
+				fclose(fp);
+		}
+	}
+	hash_destroy(table);
+	policy->destroy(cache);
+	extent_destroy(extents);
+	trace_close(trace);
 	return 0;
 }			
  
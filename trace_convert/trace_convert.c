@@ -0,0 +1,65 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "types.h"
+#include "trace.h"
+
+/*
+ * spc trace, text or binary, on stdin to the binary form on stdout, or
+ * back to text with -t.
+ */
+int main(int argc, char **argv)
+{
+	struct trace *trace;
+	struct trace_writer *tw = NULL;
+	struct trace_rec recs[TRACE_BATCH];
+	uint64 size, bytes = 0;
+	uint32 n, i;
+	int text = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "t")) != -1) {
+		switch (opt) {
+		case 't':
+			text = 1;
+			break;
+		default:
+			printf("Usage: ./trace_convert [-t] < trace > converted\n");
+			return -1;
+		}
+	}
+	trace = trace_open(NULL);
+	if (!trace || !trace_read_size(trace, &size)) {
+		fprintf(stderr, "Cannot read the trace\n");
+		return -1;
+	}
+	if (text) {
+		bytes = printf("%lld\n", size);
+	} else if (!(tw = trace_writer_open(stdout, size, 0))) {
+		fprintf(stderr, "Cannot write the trace\n");
+		return -1;
+	}
+	while ((n = trace_next_batch(trace, recs, TRACE_BATCH))) {
+		for (i=0; i<n; i++) {
+			if (text) {
+				bytes += printf("%lld %lld %c\n", recs[i].start, recs[i].len, recs[i].rw);
+			} else if (!trace_write(tw, &recs[i])) {
+				fprintf(stderr, "Cannot write the trace\n");
+				return -1;
+			}
+		}
+	}
+	if (tw) {
+		bytes = tw->bytes;
+		if (!trace_writer_close(tw)) {
+			fprintf(stderr, "Cannot write the trace\n");
+			return -1;
+		}
+	}
+	fprintf(stderr, "%lld records, %lld bytes, %.2f bytes/record\n", trace->records, bytes,
+		trace->records ? (double)bytes/trace->records : 0.0);
+	trace_close(trace);
+	return 0;
+}